@@ -0,0 +1,229 @@
+/*
+ * Benchmark of the draw call overhead, with and without the state cache and RenderQueue.
+ *
+ * Usage: Configure with -DTNM046_BUILD_BENCHMARKS=ON and run draw-benchmark from this
+ *        directory, so that the textures are found. It draws frames of 2000 small meshes
+ *        in a small hidden window, so that little time is spent on vertices and pixels,
+ *        and prints the best time per frame for:
+ *        - binding the program, texture and VAO, drawing and binding 0 again for every
+ *          draw, as the code did before GLState.hpp,
+ *        - the same draws through the state cache,
+ *        - draws with random programs, textures and meshes, in the order they were made,
+ *        - the same draws sorted by a RenderQueue.
+ *        The times include glFinish(), so they cover the driver and the GPU.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "GLState.hpp"
+#include "RenderQueue.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+#include "TriangleSoup.hpp"
+
+static const int numDraws = 2000;
+static const int numFrames = 50;
+
+static const char vertexSource[] = R"glsl(#version 330 core
+layout(location = 0) in vec3 Position;
+layout(location = 2) in vec2 TexCoord;
+uniform vec3 offset;
+out vec2 st;
+void main() {
+    st = TexCoord;
+    gl_Position = vec4(Position + offset, 1.0);
+}
+)glsl";
+
+static const char fragmentSource[] = R"glsl(#version 330 core
+in vec2 st;
+out vec4 finalcolor;
+uniform sampler2D tex;
+void main() {
+    finalcolor = TINT * texture(tex, st);
+}
+)glsl";
+
+// One draw: indices of its program, texture and mesh, and where it is drawn
+struct Draw {
+    size_t shader;
+    size_t texture;
+    size_t mesh;
+    GLfloat x, y, depth;
+};
+
+/* Best time of numFrames frames in milliseconds, each frame ending with glFinish() */
+static double bestFrameTime(const std::function<void()>& frame) {
+    double best = 1e30;
+    for (int i = 0; i < numFrames; i++) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glFinish();
+        const auto start = std::chrono::steady_clock::now();
+        frame();
+        glFinish();
+        const std::chrono::duration<double, std::milli> time =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, time.count());
+    }
+    return best;
+}
+
+static void printTime(const char* name, double milliseconds) {
+    printf("%-44s %8.2f ms per frame, %6.2f us per draw\n", name, milliseconds,
+           1000.0 * milliseconds / numDraws);
+}
+
+int main(int, char*[]) {
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "Draw benchmark", nullptr, nullptr);
+    if (!window) {
+        std::cout << "Unable to open window. Terminating.\n";
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    GLenum err = glewInit();
+    if (GLEW_OK != err) {
+        std::cerr << "Error: " << glewGetErrorString(err) << "\n";
+        glfwTerminate();
+        return -1;
+    }
+    std::cout << "GL renderer: " << glGetString(GL_RENDERER) << "\n";
+
+    {
+        // Three programs which differ only in their tint
+        const std::filesystem::path directory = std::filesystem::temp_directory_path();
+        const std::string vertexFile = (directory / "drawbenchmark_vertex.glsl").string();
+        const std::string fragmentFile = (directory / "drawbenchmark_fragment.glsl").string();
+        std::ofstream(vertexFile) << vertexSource;
+        std::ofstream(fragmentFile) << fragmentSource;
+        Shader::setCacheDirectory("");
+        std::vector<Shader> shaders;
+        for (const char* tint : {"TINT=vec4(1.0)", "TINT=vec4(1.0, 0.5, 0.5, 1.0)",
+                                 "TINT=vec4(0.5, 0.5, 1.0, 1.0)"}) {
+            shaders.emplace_back(vertexFile, fragmentFile, std::vector<std::string>{tint});
+        }
+        for (Shader& shader : shaders) {
+            shader.setUniform("tex", 0);
+        }
+
+        Texture::setCacheDirectory("");
+        std::vector<Texture> textures;
+        for (const char* file : {"textures/earth.tga", "textures/moon.tga", "textures/sun.tga",
+                                 "textures/pyramid.tga"}) {
+            textures.emplace_back(file);
+        }
+
+        // Meshes with few vertices, so that the time is spent on the draw calls
+        std::vector<TriangleSoup> meshes(5);
+        meshes[0].createBox(0.05f, 0.05f, 0.05f);
+        meshes[1].createBox(0.08f, 0.08f, 0.08f);
+        meshes[2].createSphere(0.05f, 3);
+        meshes[3].createSphere(0.05f, 4);
+        meshes[4].createTriangle();
+
+        std::mt19937 random(1);
+        std::uniform_real_distribution<GLfloat> position(-0.9f, 0.9f);
+        std::uniform_real_distribution<GLfloat> depth(0.0f, 1.0f);
+        std::vector<Draw> draws(numDraws);
+        for (Draw& draw : draws) {
+            draw = {random() % shaders.size(), random() % textures.size(), random() % meshes.size(),
+                    position(random), position(random), depth(random)};
+        }
+
+        glEnable(GL_DEPTH_TEST);
+        glstate::invalidate();
+
+        // One program, textures in runs of 500 draws and meshes in runs of 4 draws
+        auto runDraw = [&](int i) {
+            Draw draw = draws[i];
+            draw.shader = 0;
+            draw.texture = static_cast<size_t>(i / 500 % 2);
+            draw.mesh = static_cast<size_t>(i / 4 % 4);
+            return draw;
+        };
+        const double unbinding = bestFrameTime([&] {
+            for (int i = 0; i < numDraws; i++) {
+                const Draw draw = runDraw(i);
+                Shader& shader = shaders[draw.shader];
+                // Forget the bindings, so that every call below reaches OpenGL
+                glstate::invalidate();
+                shader.use();
+                textures[draw.texture].bind(0);
+                shader.setUniform("offset", draw.x, draw.y, 0.0f);
+                meshes[draw.mesh].render();
+                glstate::bindVertexArray(0);
+                glstate::bindTexture(GL_TEXTURE_2D, 0);
+                glstate::useProgram(0);
+            }
+        });
+        printTime("Bind and unbind for each draw", unbinding);
+        glstate::invalidate();
+        const double cached = bestFrameTime([&] {
+            for (int i = 0; i < numDraws; i++) {
+                const Draw draw = runDraw(i);
+                Shader& shader = shaders[draw.shader];
+                shader.use();
+                textures[draw.texture].bind(0);
+                shader.setUniform("offset", draw.x, draw.y, 0.0f);
+                meshes[draw.mesh].render();
+            }
+        });
+        printTime("The same draws through the state cache", cached);
+
+        const double unsorted = bestFrameTime([&] {
+            for (const Draw& draw : draws) {
+                Shader& shader = shaders[draw.shader];
+                shader.use();
+                textures[draw.texture].bind(0);
+                shader.setUniform("offset", draw.x, draw.y, draw.depth);
+                meshes[draw.mesh].render(shader);
+            }
+        });
+        printTime("Random draws in the order they were made", unsorted);
+
+        RenderQueue queue;
+        RenderQueue::Stats stats;
+        const double sorted = bestFrameTime([&] {
+            for (size_t i = 0; i < draws.size(); i++) {
+                const Draw& draw = draws[i];
+                queue.add(shaders[draw.shader], &textures[draw.texture], meshes[draw.mesh],
+                          draw.depth, RenderQueue::Pass::Opaque, static_cast<uint32_t>(i));
+            }
+            stats = queue.submit([&](uint32_t id) {
+                const Draw& draw = draws[id];
+                shaders[draw.shader].setUniform("offset", draw.x, draw.y, draw.depth);
+            });
+        });
+        printTime("The same draws sorted by a RenderQueue", sorted);
+        printf("RenderQueue: %zu program, %zu texture and %zu mesh changes for %zu draws\n",
+               stats.programChanges, stats.textureChanges, stats.meshChanges, stats.draws);
+
+        const GLenum error = glGetError();
+        if (error != GL_NO_ERROR) {
+            std::cerr << "OpenGL error " << error << "\n";
+        }
+    }
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * A cache of the OpenGL state which is changed for every draw call
+ *
+ * This code is in the public domain.
+ */
+#include "GLState.hpp"
+
+namespace glstate {
+
+static const GLuint unknown = ~0u;  // State which has to be sent to OpenGL
+static const GLuint maxUnits = 32;
+static const GLuint maxBindings = 16;  // Indexed uniform buffer bindings
+
+static const GLenum textureTargets[] = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D,
+                                        GL_TEXTURE_CUBE_MAP};
+static const GLenum bufferTargets[] = {GL_ARRAY_BUFFER,        GL_UNIFORM_BUFFER,
+                                       GL_PIXEL_PACK_BUFFER,   GL_PIXEL_UNPACK_BUFFER,
+                                       GL_COPY_READ_BUFFER,    GL_COPY_WRITE_BUFFER};
+static const GLenum caps[] = {GL_DEPTH_TEST,     GL_CULL_FACE,           GL_BLEND,
+                              GL_SCISSOR_TEST,   GL_STENCIL_TEST,        GL_PRIMITIVE_RESTART,
+                              GL_MULTISAMPLE,    GL_POLYGON_OFFSET_FILL, GL_FRAMEBUFFER_SRGB};
+
+static const int numTextureTargets = sizeof(textureTargets) / sizeof(textureTargets[0]);
+static const int numBufferTargets = sizeof(bufferTargets) / sizeof(bufferTargets[0]);
+static const int numCaps = sizeof(caps) / sizeof(caps[0]);
+
+struct BufferRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+struct State {
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;  // unknown, or a unit below maxUnits
+    GLuint textures[maxUnits][numTextureTargets];
+    GLuint samplers[maxUnits];
+    GLuint buffers[numBufferTargets];
+    BufferRange uniformRanges[maxBindings];
+    GLuint enabled[numCaps];  // 0, 1 or unknown
+    GLuint restartIndex;
+    bool restartIndexKnown;  // The usual restart index is ~0u, the same as unknown
+
+    State() { reset(); }
+
+    void reset() {
+        program = unknown;
+        vertexArray = unknown;
+        activeUnit = unknown;
+        for (GLuint unit = 0; unit < maxUnits; unit++) {
+            for (GLuint& texture : textures[unit]) {
+                texture = unknown;
+            }
+            samplers[unit] = unknown;
+        }
+        for (GLuint& buffer : buffers) {
+            buffer = unknown;
+        }
+        for (BufferRange& range : uniformRanges) {
+            range = {unknown, 0, 0};
+        }
+        for (GLuint& value : enabled) {
+            value = unknown;
+        }
+        restartIndex = unknown;
+        restartIndexKnown = false;
+    }
+};
+
+static State state;
+
+// Index of a cached target or capability in a table, or -1 if it is not cached
+template <int N>
+static int find(const GLenum (&table)[N], GLenum value) {
+    for (int i = 0; i < N; i++) {
+        if (table[i] == value) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void useProgram(GLuint program) {
+    if (state.program != program) {
+        state.program = program;
+        glUseProgram(program);
+    }
+}
+
+void bindVertexArray(GLuint array) {
+    if (state.vertexArray != array) {
+        state.vertexArray = array;
+        glBindVertexArray(array);
+    }
+}
+
+void activeTexture(GLenum texture) {
+    const GLuint unit = texture - GL_TEXTURE0;
+    if (state.activeUnit != unit || unit >= maxUnits) {
+        state.activeUnit = (unit < maxUnits) ? unit : unknown;
+        glActiveTexture(texture);
+    }
+}
+
+void bindTexture(GLenum target, GLuint texture) {
+    const int index = find(textureTargets, target);
+    if (index < 0 || state.activeUnit == unknown) {
+        glBindTexture(target, texture);
+        return;
+    }
+    GLuint& bound = state.textures[state.activeUnit][index];
+    if (bound != texture) {
+        bound = texture;
+        glBindTexture(target, texture);
+    }
+}
+
+void bindSampler(GLuint unit, GLuint sampler) {
+    if (unit >= maxUnits) {
+        glBindSampler(unit, sampler);
+    } else if (state.samplers[unit] != sampler) {
+        state.samplers[unit] = sampler;
+        glBindSampler(unit, sampler);
+    }
+}
+
+void bindBuffer(GLenum target, GLuint buffer) {
+    const int index = find(bufferTargets, target);
+    if (index < 0) {
+        glBindBuffer(target, buffer);
+    } else if (state.buffers[index] != buffer) {
+        state.buffers[index] = buffer;
+        glBindBuffer(target, buffer);
+    }
+}
+
+void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+                     GLsizeiptr size) {
+    if (target == GL_UNIFORM_BUFFER && index < maxBindings) {
+        BufferRange& range = state.uniformRanges[index];
+        if (range.buffer == buffer && range.offset == offset && range.size == size) {
+            bindBuffer(target, buffer);  // Binding a range also sets the generic binding
+            return;
+        }
+        range = {buffer, offset, size};
+    }
+    glBindBufferRange(target, index, buffer, offset, size);
+    const int generic = find(bufferTargets, target);
+    if (generic >= 0) {
+        state.buffers[generic] = buffer;
+    }
+}
+
+static void setCap(GLenum cap, GLuint value) {
+    const int index = find(caps, cap);
+    if (index >= 0) {
+        if (state.enabled[index] == value) {
+            return;
+        }
+        state.enabled[index] = value;
+    }
+    value ? glEnable(cap) : glDisable(cap);
+}
+
+void enable(GLenum cap) { setCap(cap, 1); }
+
+void disable(GLenum cap) { setCap(cap, 0); }
+
+void primitiveRestartIndex(GLuint index) {
+    if (!state.restartIndexKnown || state.restartIndex != index) {
+        state.restartIndex = index;
+        state.restartIndexKnown = true;
+        glPrimitiveRestartIndex(index);
+    }
+}
+
+GLuint currentProgram() {
+    if (state.program == unknown) {
+        GLint program = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+        state.program = static_cast<GLuint>(program);
+    }
+    return state.program;
+}
+
+void deleteProgram(GLuint program) {
+    // A program in use stays in use until another one is used, but its name may be reused
+    if (program != 0 && state.program == program) {
+        state.program = unknown;
+    }
+    glDeleteProgram(program);
+}
+
+// Deleted objects are unbound by OpenGL, so their bindings revert to 0
+static void unbind(GLuint& binding, GLsizei n, const GLuint* names) {
+    for (GLsizei i = 0; i < n; i++) {
+        if (names[i] != 0 && binding == names[i]) {
+            binding = 0;
+        }
+    }
+}
+
+void deleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    unbind(state.vertexArray, n, arrays);
+    glDeleteVertexArrays(n, arrays);
+}
+
+void deleteTextures(GLsizei n, const GLuint* textures) {
+    for (auto& unit : state.textures) {
+        for (GLuint& texture : unit) {
+            unbind(texture, n, textures);
+        }
+    }
+    glDeleteTextures(n, textures);
+}
+
+void deleteSamplers(GLsizei n, const GLuint* samplers) {
+    for (GLuint& sampler : state.samplers) {
+        unbind(sampler, n, samplers);
+    }
+    glDeleteSamplers(n, samplers);
+}
+
+void deleteBuffers(GLsizei n, const GLuint* buffers) {
+    for (GLuint& buffer : state.buffers) {
+        unbind(buffer, n, buffers);
+    }
+    for (BufferRange& range : state.uniformRanges) {
+        for (GLsizei i = 0; i < n; i++) {
+            if (buffers[i] != 0 && range.buffer == buffers[i]) {
+                range.buffer = unknown;
+            }
+        }
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void invalidate() { state.reset(); }
+
+}  // namespace glstate
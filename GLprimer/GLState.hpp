@@ -0,0 +1,47 @@
+/*
+ * A cache of the OpenGL state which is changed for every draw call.
+ *
+ * Usage: Call these functions instead of the OpenGL functions with the same names.
+ *        They remember what is bound and enabled, and leave out calls which would not
+ *        change anything, so that objects can be bound before each draw without
+ *        unbinding them afterwards. TriangleSoup, Texture, TextureRegistry and
+ *        Shader::use() go through the cache.
+ *        Delete objects with the functions here too, since OpenGL unbinds deleted
+ *        objects and may reuse their names.
+ *        GL_ELEMENT_ARRAY_BUFFER is part of the vertex array object, so it is not cached.
+ *        Call invalidate() after changing cached state with OpenGL calls directly.
+ *        The cache is for the context of the rendering thread only.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GL/glew.h>
+
+namespace glstate {
+
+void useProgram(GLuint program);
+void bindVertexArray(GLuint array);
+void activeTexture(GLenum texture);  // GL_TEXTURE0 + unit, like glActiveTexture()
+void bindTexture(GLenum target, GLuint texture);
+void bindSampler(GLuint unit, GLuint sampler);
+void bindBuffer(GLenum target, GLuint buffer);
+void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+                     GLsizeiptr size);
+void enable(GLenum cap);
+void disable(GLenum cap);
+void primitiveRestartIndex(GLuint index);
+
+// returns the program in use, asking OpenGL only if it is not known
+GLuint currentProgram();
+
+void deleteProgram(GLuint program);
+void deleteVertexArrays(GLsizei n, const GLuint* arrays);
+void deleteTextures(GLsizei n, const GLuint* textures);
+void deleteSamplers(GLsizei n, const GLuint* samplers);
+void deleteBuffers(GLsizei n, const GLuint* buffers);
+
+// Forget all cached state, so that the next calls are passed on to OpenGL
+void invalidate();
+
+}  // namespace glstate
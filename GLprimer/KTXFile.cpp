@@ -0,0 +1,308 @@
+/*
+ * Reading and writing of KTX 1.1 files
+ *
+ * The file starts with a 12 byte identifier and a header of 13 uint32 values,
+ * followed by key/value pairs and, for each mipmap level, its size in bytes and its
+ * data. Key/value pairs and levels are padded to 4 bytes.
+ * See https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "KTXFile.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace ktx {
+
+static const std::array<uint8_t, 12> identifier = {
+    {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'}};
+static const uint32_t endianness = 0x04030201;
+static const char swizzleKey[] = "KTXswizzle";
+
+struct Header {
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+static uint32_t padding(size_t size) { return static_cast<uint32_t>(3 - ((size + 3) % 4)); }
+
+// Bytes per 4x4 block of a block compressed format, or 0 if the format is not known
+static size_t compressedBlockSize(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            return 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RG_RGTC2:
+        case GL_COMPRESSED_SIGNED_RG_RGTC2:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+        case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+// Bytes per pixel of uncompressed data, or 0 if the format or type is not known
+static size_t bytesPerPixel(GLenum format, GLenum type) {
+    size_t components = 0;
+    switch (format) {
+        case GL_RED:
+            components = 1;
+            break;
+        case GL_RG:
+            components = 2;
+            break;
+        case GL_RGB:
+        case GL_BGR:
+            components = 3;
+            break;
+        case GL_RGBA:
+        case GL_BGRA:
+            components = 4;
+            break;
+    }
+    switch (type) {
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+            return components;
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+        case GL_HALF_FLOAT:
+            return components * 2;
+        case GL_UNSIGNED_INT:
+        case GL_INT:
+        case GL_FLOAT:
+            return components * 4;
+        default:
+            return 0;
+    }
+}
+
+size_t rowPitch(GLuint width, size_t bytesPerPixel) {
+    return (width * bytesPerPixel + 3) & ~static_cast<size_t>(3);
+}
+
+std::vector<GLubyte> padRows(const GLubyte* pixels, GLuint width, GLuint height,
+                             size_t bytesPerPixel) {
+    const size_t rowSize = width * bytesPerPixel;
+    const size_t pitch = rowPitch(width, bytesPerPixel);
+    if (pitch == rowSize) {
+        return std::vector<GLubyte>(pixels, pixels + rowSize * height);
+    }
+    std::vector<GLubyte> padded(pitch * height, 0);
+    for (GLuint y = 0; y < height; y++) {
+        std::memcpy(&padded[y * pitch], pixels + y * rowSize, rowSize);
+    }
+    return padded;
+}
+
+bool read(const std::string& filename, KTXImage& image) {
+    image.releaseData();
+    if (!image.file.open(filename)) {
+        return false;  // Not an error, callers use this to probe caches
+    }
+    const GLubyte* data = image.file.data();
+    const size_t size = image.file.size();
+
+    std::array<uint8_t, 12> id;
+    Header header;
+    if (size < id.size() + sizeof(header)) {
+        std::cerr << "Not a KTX file ('" << filename << "')\n";
+        image.releaseData();
+        return false;
+    }
+    std::memcpy(id.data(), data, id.size());
+    std::memcpy(&header, data + id.size(), sizeof(header));
+    if (id != identifier) {
+        std::cerr << "Not a KTX file ('" << filename << "')\n";
+        image.releaseData();
+        return false;
+    }
+    if (header.endianness != endianness) {
+        std::cerr << "KTX files in the opposite byte order are not supported ('" << filename
+                  << "')\n";
+        image.releaseData();
+        return false;
+    }
+    if (header.pixelHeight == 0 || header.pixelDepth > 1 || header.numberOfArrayElements != 0 ||
+        header.numberOfFaces != 1) {
+        std::cerr << "Only 2D textures are supported in KTX files ('" << filename << "')\n";
+        image.releaseData();
+        return false;
+    }
+    // The levels are uploaded straight from the file, so each of them must hold at least
+    // the data OpenGL reads for its size
+    const bool compressed = (header.glType == 0);
+    const size_t blockSize = compressedBlockSize(header.glInternalFormat);
+    const size_t pixelSize = bytesPerPixel(header.glFormat, header.glType);
+    if (compressed ? (blockSize == 0) : (pixelSize == 0)) {
+        std::cerr << "Unsupported KTX pixel format ('" << filename << "')\n";
+        image.releaseData();
+        return false;
+    }
+    uint32_t fullChain = 1;
+    while ((static_cast<uint64_t>(std::max(header.pixelWidth, header.pixelHeight)) >> fullChain) !=
+           0) {
+        fullChain++;
+    }
+    if (header.pixelWidth == 0 || header.numberOfMipmapLevels > fullChain) {
+        std::cerr << "Invalid KTX image size or number of mipmap levels ('" << filename
+                  << "')\n";
+        image.releaseData();
+        return false;
+    }
+    size_t pos = id.size() + sizeof(header);
+    if (header.bytesOfKeyValueData > size - pos) {
+        std::cerr << "Could not read KTX image data ('" << filename << "')\n";
+        image.releaseData();
+        return false;
+    }
+
+    // Key/value pairs: uint32 size, then the key and value separated by a null byte
+    const char* keyValues = reinterpret_cast<const char*>(data + pos);
+    const size_t keyValueSize = header.bytesOfKeyValueData;
+    image.swizzle.clear();
+    for (size_t kv = 0; kv + 4 <= keyValueSize;) {
+        uint32_t pairSize;
+        std::memcpy(&pairSize, &keyValues[kv], 4);
+        kv += 4;
+        if (pairSize > keyValueSize - kv) {
+            break;
+        }
+        const char* pair = &keyValues[kv];
+        const char* key = std::find(pair, pair + pairSize, '\0');
+        const char* value = key + 1;
+        if (value < pair + pairSize && std::string(pair, key) == swizzleKey) {
+            image.swizzle.assign(value, std::find(value, pair + pairSize, '\0'));
+        }
+        kv += pairSize + padding(pairSize);
+    }
+    pos += keyValueSize;
+
+    image.glType = header.glType;
+    image.glFormat = header.glFormat;
+    image.glInternalFormat = header.glInternalFormat;
+    image.glBaseInternalFormat = header.glBaseInternalFormat;
+    image.width = header.pixelWidth;
+    image.height = header.pixelHeight;
+
+    // The levels are left in the mapped file, only their positions are recorded
+    const uint32_t numLevels = std::max(header.numberOfMipmapLevels, 1u);
+    for (uint32_t level = 0; level < numLevels; level++) {
+        uint32_t imageSize = 0;
+        if (size - pos < sizeof(imageSize)) {
+            break;
+        }
+        std::memcpy(&imageSize, data + pos, sizeof(imageSize));
+        pos += sizeof(imageSize);
+        if (imageSize > size - pos) {
+            break;
+        }
+        const GLuint width = std::max(header.pixelWidth >> level, 1u);
+        const GLuint height = std::max(header.pixelHeight >> level, 1u);
+        const size_t rowBytes = compressed ? (width + 3) / 4 * blockSize
+                                           : rowPitch(width, pixelSize);
+        const size_t rows = compressed ? (height + 3) / 4 : height;
+        if (imageSize / rows < rowBytes) {  // Divided, since rows * rowBytes may overflow
+            break;
+        }
+        image.mappedLevels.push_back({pos, imageSize});
+        pos += std::min<size_t>(imageSize + padding(imageSize), size - pos);
+    }
+    if (image.mappedLevels.size() != numLevels) {
+        std::cerr << "Could not read KTX image data ('" << filename << "')\n";
+        image.releaseData();
+        return false;
+    }
+    return true;
+}
+
+bool write(const std::string& filename, const KTXImage& image) {
+    std::vector<char> keyValues;
+    if (!image.swizzle.empty()) {
+        const uint32_t size = static_cast<uint32_t>(sizeof(swizzleKey) + image.swizzle.size() + 1);
+        keyValues.resize(4 + size + padding(size), 0);
+        std::memcpy(&keyValues[0], &size, 4);
+        std::memcpy(&keyValues[4], swizzleKey, sizeof(swizzleKey));
+        std::memcpy(&keyValues[4 + sizeof(swizzleKey)], image.swizzle.data(),
+                    image.swizzle.size());
+    }
+
+    Header header{};
+    header.endianness = endianness;
+    header.glType = image.glType;
+    header.glTypeSize = 1;  // Bytes per component for GL_UNSIGNED_BYTE, 1 if compressed
+    header.glFormat = image.glFormat;
+    header.glInternalFormat = image.glInternalFormat;
+    header.glBaseInternalFormat = image.glBaseInternalFormat;
+    header.pixelWidth = image.width;
+    header.pixelHeight = image.height;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = static_cast<uint32_t>(image.numLevels());
+    header.bytesOfKeyValueData = static_cast<uint32_t>(keyValues.size());
+
+    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+    out.write(reinterpret_cast<const char*>(identifier.data()), identifier.size());
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(keyValues.data(), keyValues.size());
+    const char zeros[4] = {};
+    for (size_t level = 0; level < image.numLevels(); level++) {
+        const uint32_t imageSize = static_cast<uint32_t>(image.levelSize(level));
+        out.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+        out.write(reinterpret_cast<const char*>(image.levelData(level)), imageSize);
+        out.write(zeros, padding(imageSize));
+    }
+    if (!out) {
+        std::cerr << "Could not write KTX file ('" << filename << "')\n";
+        return false;
+    }
+    return true;
+}
+
+}  // namespace ktx
+
+size_t KTXImage::numLevels() const {
+    return file.isOpen() ? mappedLevels.size() : levels.size();
+}
+
+const GLubyte* KTXImage::levelData(size_t level) const {
+    return file.isOpen() ? file.data() + mappedLevels[level].first : levels[level].data();
+}
+
+size_t KTXImage::levelSize(size_t level) const {
+    return file.isOpen() ? mappedLevels[level].second : levels[level].size();
+}
+
+void KTXImage::releaseData() {
+    levels.clear();
+    file.close();
+    mappedLevels.clear();
+}
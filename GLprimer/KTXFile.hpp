@@ -0,0 +1,57 @@
+/*
+ * Reading and writing of 2D textures with all mipmap levels in KTX 1.1 files.
+ *
+ * Usage: Fill a KTXImage with the GL format enums and the data of every mipmap level
+ *        and call ktx::write() to save it, or call ktx::read() to load a file.
+ *        Uncompressed levels have their rows padded to 4 bytes, so they can be uploaded
+ *        with the default GL_UNPACK_ALIGNMENT. Compressed levels have glType = 0.
+ *        Only files in the native byte order are read. Cube maps, arrays and 3D
+ *        textures are not supported. Files with an unknown pixel format, or with levels
+ *        too short for their size, are rejected.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+struct KTXImage {
+    GLenum glType = 0;                // GL_UNSIGNED_BYTE etc, or 0 for compressed data
+    GLenum glFormat = 0;              // Format of the pixel data (GL_BGRA etc), 0 if compressed
+    GLenum glInternalFormat = 0;      // Sized or compressed internal format
+    GLenum glBaseInternalFormat = 0;  // GL_RED, GL_RG, GL_RGB or GL_RGBA
+    GLuint width = 0;
+    GLuint height = 0;
+    std::string swizzle;  // Texture swizzle as in KTX2, "rrr1" for gray. Empty for none.
+    std::vector<std::vector<GLubyte>> levels;  // Data for each mipmap level, if not mapped
+
+    // A file mapped by ktx::read(), and the offset and size of each level in it
+    MappedFile file;
+    std::vector<std::pair<size_t, size_t>> mappedLevels;
+
+    size_t numLevels() const;
+    const GLubyte* levelData(size_t level) const;
+    size_t levelSize(size_t level) const;
+
+    // Free the level data, in memory or mapped. Sizes are no longer available.
+    void releaseData();
+};
+
+namespace ktx {
+
+// Bytes per row of an uncompressed level, padded to 4 bytes
+size_t rowPitch(GLuint width, size_t bytesPerPixel);
+
+// Copy tightly packed rows into the padded layout of an uncompressed KTX level
+std::vector<GLubyte> padRows(const GLubyte* pixels, GLuint width, GLuint height,
+                             size_t bytesPerPixel);
+
+bool read(const std::string& filename, KTXImage& image);
+bool write(const std::string& filename, const KTXImage& image);
+
+}  // namespace ktx
@@ -0,0 +1,44 @@
+/*
+ * A read-only memory mapping of a whole file.
+ *
+ * Usage: Call open() with a file name, then read the contents through data() and
+ *        size(). The pages are read from disk when they are first touched, so nothing
+ *        is copied into a buffer of our own, and the kernel is told that the file will
+ *        be read from start to end. The mapping is removed by close() or the destructor.
+ *        Uses mmap() on Linux and macOS, and a file mapping object on Windows.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    /* A MappedFile owns its mapping. It can be moved but not copied. */
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Map a file, after closing a previous mapping. Returns false if the file could not be
+    // opened or mapped. An empty file is mapped with data() == nullptr.
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const;
+    const unsigned char* data() const;
+    size_t size() const;
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+#ifdef _WIN32
+    void* mapping_ = nullptr;  // HANDLE of the file mapping object
+#endif
+};
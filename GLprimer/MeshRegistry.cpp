@@ -0,0 +1,61 @@
+/*
+ * Registry of shared meshes loaded from OBJ files
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "MeshRegistry.hpp"
+#include "Utilities.hpp"
+
+#include <iostream>
+#include <vector>
+
+MeshRegistry::Handle MeshRegistry::acquire(const std::string& filename) {
+    const std::string path = util::canonicalPath(filename);
+
+    auto pathIt = byPath_.find(path);
+    if (pathIt != byPath_.end()) {
+        if (Handle mesh = pathIt->second.lock()) {
+            return mesh;
+        }
+    }
+
+    // Not loaded under this name, so look for a loaded file with identical contents
+    std::vector<char> contents;
+    if (!util::readFileBytes(path, contents)) {
+        std::cerr << "File not found: " << filename << "\n";
+        return {};
+    }
+    const auto key = std::make_pair(util::hashBytes(contents.data(), contents.size()),
+                                    contents.size());
+
+    auto contentIt = byContent_.find(key);
+    if (contentIt != byContent_.end()) {
+        if (Handle mesh = contentIt->second.lock()) {
+            byPath_[path] = mesh;
+            return mesh;
+        }
+    }
+
+    // readOBJ() reads the file a second time. It parses from a FILE*, and the hash above
+    // is only taken for files which are not loaded yet, so this is left as it is.
+    Handle mesh = std::make_shared<TriangleSoup>();
+    mesh->readOBJ(path);
+    if (mesh->vao() == 0 || mesh->numTriangles() == 0) {
+        // Do not cache a mesh which could not be parsed, so that a fixed file is read again
+        return {};
+    }
+    byPath_[path] = mesh;
+    byContent_[key] = mesh;
+    return mesh;
+}
+
+size_t MeshRegistry::size() const {
+    return util::countAlive(byContent_);
+}
+
+void MeshRegistry::purge() {
+    util::eraseExpired(byPath_);
+    util::eraseExpired(byContent_);
+}
@@ -0,0 +1,43 @@
+/*
+ * A registry to share meshes loaded from OBJ files.
+ *
+ * Usage: Call acquire() with an OBJ file name to get a shared handle to the mesh,
+ *        and call render() on the handle as on any TriangleSoup. Meshes are keyed by
+ *        canonical path and by a hash of the file contents, so the same file, or
+ *        byte-identical files under different names, are parsed and uploaded only once.
+ *        The GL buffers of a mesh are deleted when the last handle to it is released.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "TriangleSoup.hpp"
+
+class MeshRegistry {
+public:
+    using Handle = std::shared_ptr<TriangleSoup>;
+
+    // Return the mesh for an OBJ file, loading it if it is not already loaded.
+    // Returns an empty handle if the file could not be read or parsed, or has no
+    // triangles. Such files are not cached, so they are read again on the next call.
+    Handle acquire(const std::string& filename);
+
+    // Number of distinct meshes currently alive
+    size_t size() const;
+
+    // Forget entries whose meshes have been released
+    void purge();
+
+private:
+    // Meshes by canonical path, for a lookup without reading the file
+    std::unordered_map<std::string, std::weak_ptr<TriangleSoup>> byPath_;
+    // Meshes by (content hash, file size), to find identical files under other names
+    std::map<std::pair<uint64_t, size_t>, std::weak_ptr<TriangleSoup>> byContent_;
+};
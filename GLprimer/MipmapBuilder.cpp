@@ -0,0 +1,295 @@
+/*
+ * CPU generation of mipmap chains
+ *
+ * Each level is computed from the previous one with a separable filter. For every
+ * output row, the source rows under the vertical filter are summed into a row of
+ * floats, which is then filtered horizontally. Weights are computed once per level
+ * for each output column and row. Sizes that are not even are handled exactly by
+ * placing the filter at the scaled pixel centers.
+ *
+ * This code is in the public domain.
+ */
+#include "MipmapBuilder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <thread>
+
+// SSE2 is always available on x86-64, so it needs no runtime check
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SIMD_SSE2 1
+#endif
+
+namespace mipmap {
+
+static const double pi = 3.14159265358979323846;
+
+/* Lookup table from sRGB encoded bytes to linear values */
+static const std::array<float, 256>& srgbToLinear() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t{};
+        for (int i = 0; i < 256; i++) {
+            const double c = i / 255.0;
+            t[i] = static_cast<float>((c <= 0.04045) ? c / 12.92
+                                                     : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        return t;
+    }();
+    return table;
+}
+
+/* Lookup table from linear values, quantized to 14 bits, to sRGB encoded bytes */
+static const int linearTableSize = 16384;
+static const std::vector<GLubyte>& linearToSrgb() {
+    static const std::vector<GLubyte> table = [] {
+        std::vector<GLubyte> t(linearTableSize);
+        for (int i = 0; i < linearTableSize; i++) {
+            const double l = i / double(linearTableSize - 1);
+            const double c = (l <= 0.0031308) ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            t[i] = static_cast<GLubyte>(std::lround(std::clamp(c, 0.0, 1.0) * 255.0));
+        }
+        return t;
+    }();
+    return table;
+}
+
+/* Zeroth order modified Bessel function of the first kind, for the Kaiser window */
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Filter taps for one output pixel: source index range and normalized weights
+struct Taps {
+    int first = 0;
+    std::vector<float> weights;
+};
+
+/*
+ * Compute the taps for each output pixel along one axis. Source pixels outside the
+ * image are clamped to the edge, so their weights are added to the edge pixels.
+ */
+static std::vector<Taps> computeTaps(GLuint srcSize, GLuint dstSize, Filter filter) {
+    const double scale = static_cast<double>(srcSize) / dstSize;
+    // Support radius in source pixels. The Kaiser filter spans 3 output pixels on each side.
+    const double radius = (filter == Filter::Box) ? 0.5 * scale : 3.0 * scale;
+    const double alpha = 4.0;  // Kaiser window shape
+    const double kaiserNorm = besselI0(alpha);
+
+    std::vector<Taps> taps(dstSize);
+    for (GLuint x = 0; x < dstSize; x++) {
+        const double center = (x + 0.5) * scale;
+        const int lo = static_cast<int>(std::floor(center - radius));
+        const int hi = static_cast<int>(std::ceil(center + radius));
+        const int first = std::max(lo, 0);
+        const int last = std::min(hi, static_cast<int>(srcSize) - 1);
+        std::vector<double> w(last - first + 1, 0.0);
+        for (int i = lo; i <= hi; i++) {
+            double weight;
+            if (filter == Filter::Box) {
+                // Overlap of the source pixel [i, i+1] with the box around the center
+                weight = std::max(0.0, std::min(i + 1.0, center + radius) -
+                                           std::max(static_cast<double>(i), center - radius));
+            } else {
+                const double d = (i + 0.5 - center) / scale;  // In output pixels
+                const double r = d / 3.0;
+                if (std::fabs(r) >= 1.0) {
+                    continue;
+                }
+                const double sinc = (d == 0.0) ? 1.0 : std::sin(pi * d) / (pi * d);
+                weight = sinc * besselI0(alpha * std::sqrt(1.0 - r * r)) / kaiserNorm;
+            }
+            w[std::clamp(i, first, last) - first] += weight;
+        }
+        double sum = 0.0;
+        for (double v : w) {
+            sum += v;
+        }
+        taps[x].first = first;
+        taps[x].weights.resize(w.size());
+        for (size_t k = 0; k < w.size(); k++) {
+            taps[x].weights[k] = static_cast<float>(w[k] / sum);
+        }
+    }
+    return taps;
+}
+
+/* row[i] += w * values[i] for n floats */
+static void addScaled(float* row, const float* values, size_t n, float w) {
+    size_t i = 0;
+#if defined(MIPMAP_SIMD_SSE2)
+    const __m128 weight = _mm_set1_ps(w);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 v = _mm_mul_ps(weight, _mm_loadu_ps(values + i));
+        _mm_storeu_ps(row + i, _mm_add_ps(_mm_loadu_ps(row + i), v));
+    }
+#endif
+    for (; i < n; i++) {
+        row[i] += w * values[i];
+    }
+}
+
+/* row[i] += w * bytes[i] / 255 for n bytes */
+static void addScaledUnorm(float* row, const GLubyte* bytes, size_t n, float w) {
+    size_t i = 0;
+#if defined(MIPMAP_SIMD_SSE2)
+    // Dividing, rather than multiplying by 1/255, gives the same values as the scalar code
+    const __m128 weight = _mm_set1_ps(w);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+        const __m128i lo = _mm_unpacklo_epi8(b, zero);
+        const __m128i hi = _mm_unpackhi_epi8(b, zero);
+        const __m128i quarters[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                                     _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+        for (int q = 0; q < 4; q++) {
+            const __m128 v = _mm_div_ps(_mm_cvtepi32_ps(quarters[q]), scale);
+            float* r = row + i + 4 * q;
+            _mm_storeu_ps(r, _mm_add_ps(_mm_loadu_ps(r), _mm_mul_ps(weight, v)));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        row[i] += w * (static_cast<float>(bytes[i]) / 255.0f);
+    }
+}
+
+/*
+ * Filter the output rows [rowBegin, rowEnd)
+ *
+ * The vertical pass adds 16 bytes at a time when no channel is sRGB. sRGB rows are
+ * decoded through the lookup tables first, and then added 4 floats at a time. The
+ * horizontal pass filters the channels of 3 and 4 channel pixels together. Both passes
+ * add in the same order as the scalar code, so the results do not depend on SSE2.
+ */
+static void filterRows(const GLubyte* src, GLuint srcWidth, int channels, bool srgb,
+                       const std::vector<Taps>& tapsX, const std::vector<Taps>& tapsY,
+                       GLuint rowBegin, GLuint rowEnd, GLubyte* dst) {
+    static const std::array<float, 256> unorm = [] {
+        std::array<float, 256> t{};
+        for (int i = 0; i < 256; i++) {
+            t[i] = static_cast<float>(i) / 255.0f;
+        }
+        return t;
+    }();
+    const std::vector<GLubyte>& encode = linearToSrgb();
+    const int colorChannels = (channels >= 3) ? 3 : 1;
+    const GLuint dstWidth = static_cast<GLuint>(tapsX.size());
+
+    // Per channel: decode from sRGB or scale to [0, 1]
+    std::array<bool, 4> linearize{};
+    std::array<const float*, 4> decode{};
+    for (int c = 0; c < channels; c++) {
+        linearize[c] = srgb && c < colorChannels;
+        decode[c] = linearize[c] ? srgbToLinear().data() : unorm.data();
+    }
+
+    const size_t rowSize = static_cast<size_t>(srcWidth) * channels;
+    // One float more than the row, for 4 channel loads of the last pixel of 3 channel rows
+    std::vector<float> row(rowSize + 1, 0.0f);
+    std::vector<float> decoded(srgb ? rowSize : 0);
+    for (GLuint y = rowBegin; y < rowEnd; y++) {
+        // Vertical pass into a row of floats
+        std::fill(row.begin(), row.end(), 0.0f);
+        const Taps& ty = tapsY[y];
+        for (size_t k = 0; k < ty.weights.size(); k++) {
+            const GLubyte* srcRow = src + (ty.first + k) * rowSize;
+            const float w = ty.weights[k];
+            if (srgb) {
+                for (size_t i = 0; i < rowSize; i += channels) {
+                    for (int c = 0; c < channels; c++) {
+                        decoded[i + c] = decode[c][srcRow[i + c]];
+                    }
+                }
+                addScaled(row.data(), decoded.data(), rowSize, w);
+            } else {
+                addScaledUnorm(row.data(), srcRow, rowSize, w);
+            }
+        }
+
+        // Horizontal pass and conversion back to bytes
+        GLubyte* dstRow = dst + static_cast<size_t>(y) * dstWidth * channels;
+        for (GLuint x = 0; x < dstWidth; x++) {
+            const Taps& tx = tapsX[x];
+            std::array<float, 4> v{};
+#if defined(MIPMAP_SIMD_SSE2)
+            if (channels >= 3) {
+                __m128 sum = _mm_setzero_ps();
+                for (size_t k = 0; k < tx.weights.size(); k++) {
+                    const __m128 pixel = _mm_loadu_ps(&row[(tx.first + k) * channels]);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(tx.weights[k]), pixel));
+                }
+                _mm_storeu_ps(v.data(), sum);
+            } else
+#endif
+            {
+                for (int c = 0; c < channels; c++) {
+                    for (size_t k = 0; k < tx.weights.size(); k++) {
+                        v[c] += tx.weights[k] * row[(tx.first + k) * channels + c];
+                    }
+                }
+            }
+            for (int c = 0; c < channels; c++) {
+                const float value = std::clamp(v[c], 0.0f, 1.0f);
+                dstRow[x * channels + c] =
+                    linearize[c] ? encode[static_cast<int>(value * (linearTableSize - 1) + 0.5f)]
+                                 : static_cast<GLubyte>(value * 255.0f + 0.5f);
+            }
+        }
+    }
+}
+
+Level downsample(const GLubyte* pixels, GLuint width, GLuint height, int channels, bool srgb,
+                 Filter filter, unsigned numThreads) {
+    Level level;
+    level.width = std::max(width / 2, 1u);
+    level.height = std::max(height / 2, 1u);
+    level.data.resize(static_cast<size_t>(level.width) * level.height * channels);
+
+    const std::vector<Taps> tapsX = computeTaps(width, level.width, filter);
+    const std::vector<Taps> tapsY = computeTaps(height, level.height, filter);
+
+    if (numThreads == 0) {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    // Small levels are not worth starting threads for
+    numThreads = std::clamp(level.width * level.height / 16384, 1u, numThreads);
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < numThreads; t++) {
+        threads.emplace_back(filterRows, pixels, width, channels, srgb, std::cref(tapsX),
+                             std::cref(tapsY), level.height * t / numThreads,
+                             level.height * (t + 1) / numThreads, level.data.data());
+    }
+    filterRows(pixels, width, channels, srgb, tapsX, tapsY, 0, level.height / numThreads,
+               level.data.data());
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return level;
+}
+
+std::vector<Level> build(const GLubyte* pixels, GLuint width, GLuint height, int channels,
+                         bool srgb, Filter filter, unsigned numThreads) {
+    std::vector<Level> levels;
+    while (width > 1 || height > 1) {
+        levels.push_back(downsample(pixels, width, height, channels, srgb, filter, numThreads));
+        pixels = levels.back().data.data();
+        width = levels.back().width;
+        height = levels.back().height;
+    }
+    return levels;
+}
+
+}  // namespace mipmap
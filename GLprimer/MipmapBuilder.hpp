@@ -0,0 +1,44 @@
+/*
+ * CPU generation of mipmap chains for 8-bit images.
+ *
+ * Usage: Call mipmap::build() with the pixels of the base level to get all smaller
+ *        levels down to 1x1. Images with 3 or 4 channels have their first three
+ *        channels treated as color, images with 1 or 2 channels their first channel.
+ *        The last channel of 2 and 4 channel images is alpha. With srgb = true the color
+ *        channels are filtered in linear light, which keeps the brightness of the image
+ *        constant across levels. Alpha is always filtered as stored.
+ *        The rows of each level are filtered in parallel, with SSE2 where available.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <vector>
+
+namespace mipmap {
+
+enum class Filter {
+    Box,    // Area average, 2x2 pixels for even sizes. Fast, slightly blurry.
+    Kaiser  // Kaiser windowed sinc over 12 pixels. Sharper, little aliasing.
+};
+
+struct Level {
+    GLuint width = 0;
+    GLuint height = 0;
+    std::vector<GLubyte> data;  // Tightly packed rows
+};
+
+/*
+ * Build the levels below a base image with the given number of channels (1 to 4).
+ * The result starts with level 1 (half size) and ends with the 1x1 level.
+ * numThreads = 0 uses one thread per hardware thread.
+ */
+std::vector<Level> build(const GLubyte* pixels, GLuint width, GLuint height, int channels,
+                         bool srgb, Filter filter = Filter::Box, unsigned numThreads = 0);
+
+/* Downsample an image to half its size (rounded down, at least 1) */
+Level downsample(const GLubyte* pixels, GLuint width, GLuint height, int channels, bool srgb,
+                 Filter filter = Filter::Box, unsigned numThreads = 0);
+
+}  // namespace mipmap
@@ -0,0 +1,134 @@
+/*
+ * A queue of draws which are sorted to change as little OpenGL state as possible
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "RenderQueue.hpp"
+#include "GLState.hpp"
+
+#include <cstring>
+
+/*
+ * Bits of the sort key. Opaque draws are sorted by program, texture, VAO and depth,
+ * transparent draws by depth first. Names above 10 or 12 bits share key values with
+ * other names, which only makes the grouping less tight.
+ */
+static const int passShift = 62;
+static const uint64_t programMask = 0x3FF;
+static const uint64_t textureMask = 0xFFF;
+static const uint64_t vaoMask = 0xFFF;
+static const uint64_t depthMask = 0xFFFFFFF;
+
+/* Depth as 28 bits which sort like the float. Positive floats sort like their bits. */
+static uint64_t depthBits(float depth) {
+    if (!(depth > 0.0f)) {
+        return 0;  // Also NaN
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits >> 3;  // The sign bit is 0, so this leaves 28 bits
+}
+
+/* LSD radix sort on 8-bit digits. Digits which are the same for all keys are skipped. */
+static void radixSort(std::vector<std::pair<uint64_t, uint32_t>>& keys,
+                      std::vector<std::pair<uint64_t, uint32_t>>& scratch) {
+    scratch.resize(keys.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (const auto& key : keys) {
+            counts[(key.first >> shift) & 0xFF]++;
+        }
+        if (counts[(keys[0].first >> shift) & 0xFF] == keys.size()) {
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            const size_t n = count;
+            count = offset;
+            offset += n;
+        }
+        for (const auto& key : keys) {
+            scratch[counts[(key.first >> shift) & 0xFF]++] = key;
+        }
+        keys.swap(scratch);
+    }
+}
+
+void RenderQueue::add(Shader& shader, Texture* texture, TriangleSoup& mesh, float depth,
+                      Pass pass, uint32_t id) {
+    const uint64_t program = shader.id() & programMask;
+    const uint64_t textureName = (texture != nullptr) ? (texture->id() & textureMask) : 0;
+    const uint64_t vao = mesh.vao() & vaoMask;
+    const uint64_t material = (program << 24) | (textureName << 12) | vao;
+    uint64_t key = static_cast<uint64_t>(pass) << passShift;
+    if (pass == Pass::Opaque) {
+        key |= (material << 28) | depthBits(depth);
+    } else {
+        key |= ((depthMask - depthBits(depth)) << 34) | material;  // Back to front
+    }
+    keys_.emplace_back(key, static_cast<uint32_t>(items_.size()));
+    items_.push_back({&shader, texture, &mesh, id});
+}
+
+RenderQueue::Stats RenderQueue::submit(const std::function<void(uint32_t id)>& beforeDraw) {
+    Stats stats;
+    if (items_.empty()) {
+        return stats;
+    }
+    radixSort(keys_, scratch_);
+
+    const Shader* shader = nullptr;
+    const Texture* texture = nullptr;
+    const TriangleSoup* mesh = nullptr;
+    bool textureBound = false;
+    bool transparent = false;
+    for (const auto& [key, index] : keys_) {
+        const Item& item = items_[index];
+        if (!transparent && (key >> passShift) == static_cast<uint64_t>(Pass::Transparent)) {
+            transparent = true;
+            glstate::enable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDepthMask(GL_FALSE);
+        }
+        if (item.shader != shader) {
+            shader = item.shader;
+            item.shader->use();
+            stats.programChanges++;
+        }
+        if (item.texture != texture || !textureBound) {
+            texture = item.texture;
+            textureBound = true;
+            if (item.texture != nullptr) {
+                item.texture->bind(0);
+            } else {
+                glstate::activeTexture(GL_TEXTURE0);
+                glstate::bindTexture(GL_TEXTURE_2D, 0);
+            }
+            stats.textureChanges++;
+        }
+        if (item.mesh != mesh) {
+            mesh = item.mesh;
+            stats.meshChanges++;
+        }
+        if (beforeDraw) {
+            beforeDraw(item.id);
+        }
+        item.mesh->render(*item.shader);
+        stats.draws++;
+    }
+    if (transparent) {
+        glDepthMask(GL_TRUE);
+        glstate::disable(GL_BLEND);
+    }
+    clear();
+    return stats;
+}
+
+size_t RenderQueue::size() const { return items_.size(); }
+
+void RenderQueue::clear() {
+    items_.clear();
+    keys_.clear();
+}
@@ -0,0 +1,65 @@
+/*
+ * A queue of draws which are sorted to change as little OpenGL state as possible.
+ *
+ * Usage: Call add() for each object instead of rendering it directly, then call
+ *        submit() once per frame to sort and draw everything in the queue.
+ *        Each draw gets a 64-bit sort key with, from the highest bits down, the pass,
+ *        the program, the texture, the VAO and the depth, so that draws with the same
+ *        material follow each other and each program and texture is bound once.
+ *        Opaque draws with the same state are drawn front to back, for early depth
+ *        tests. Transparent draws come after all opaque ones and are sorted back to
+ *        front, before state, with blending on and depth writes off.
+ *        The keys are sorted with a radix sort, which takes linear time.
+ *        Per-object uniforms are set by the callback passed to submit(), which gets the
+ *        id given to add() just before the object is drawn. Meshes are drawn with
+ *        TriangleSoup::render(shader), so only the attributes the shader reads are fetched.
+ *        The shaders, textures and meshes must stay alive until submit() has returned.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "Shader.hpp"
+#include "Texture.hpp"
+#include "TriangleSoup.hpp"
+
+class RenderQueue {
+public:
+    enum class Pass { Opaque, Transparent };
+
+    // State changes made by submit()
+    struct Stats {
+        size_t draws = 0;
+        size_t programChanges = 0;
+        size_t textureChanges = 0;
+        size_t meshChanges = 0;
+    };
+
+    // Queue a draw. depth is the distance from the camera along the view direction.
+    // texture may be null. It is bound to texture unit 0.
+    void add(Shader& shader, Texture* texture, TriangleSoup& mesh, float depth,
+             Pass pass = Pass::Opaque, uint32_t id = 0);
+
+    // Sort and draw the queued draws, then empty the queue
+    Stats submit(const std::function<void(uint32_t id)>& beforeDraw = nullptr);
+
+    size_t size() const;
+    void clear();
+
+private:
+    struct Item {
+        Shader* shader;
+        Texture* texture;
+        TriangleSoup* mesh;
+        uint32_t id;
+    };
+
+    std::vector<Item> items_;
+    std::vector<std::pair<uint64_t, uint32_t>> keys_;  // Sort key and index into items_
+    std::vector<std::pair<uint64_t, uint32_t>> scratch_;
+};
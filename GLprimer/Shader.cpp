@@ -10,24 +10,87 @@
 #include <GLFW/glfw3.h>
 
 #include "Shader.hpp"
+#include "GLState.hpp"
+#include "Utilities.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <utility>
+#include <vector>
 
-Shader::Shader() : programID_(0) {}
+std::string Shader::cacheDirectory_ = "shadercache";
 
-Shader::Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile) {
-    createShader(vertexshaderfile, fragmentshaderfile);
+Shader::Shader() : programID_(0), attributeMask_(0), vertexShader_(0), fragmentShader_(0) {}
+
+Shader::Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile,
+               const std::vector<std::string>& defines)
+    : programID_(0), attributeMask_(0), vertexShader_(0), fragmentShader_(0) {
+    createShader(vertexshaderfile, fragmentshaderfile, defines);
 }
 
 Shader::~Shader() {
     if (programID_ != 0) {
-        glDeleteProgram(programID_);  // free program resources
+        glstate::deleteProgram(programID_);  // free program resources
+    }
+    glDeleteShader(vertexShader_);  // 0 is ignored
+    glDeleteShader(fragmentShader_);
+}
+
+Shader::Shader(Shader&& other) noexcept
+    : programID_(std::exchange(other.programID_, 0))
+    , uniforms_(std::move(other.uniforms_))
+    , attributes_(std::move(other.attributes_))
+    , attributeMask_(std::exchange(other.attributeMask_, 0))
+    , uniformBlocks_(std::move(other.uniformBlocks_))
+    , vertexFile_(std::move(other.vertexFile_))
+    , fragmentFile_(std::move(other.fragmentFile_))
+    , defines_(std::move(other.defines_))
+    , vertexFiles_(std::move(other.vertexFiles_))
+    , fragmentFiles_(std::move(other.fragmentFiles_))
+    , vertexShader_(std::exchange(other.vertexShader_, 0))
+    , fragmentShader_(std::exchange(other.fragmentShader_, 0)) {
+    other.uniforms_.clear();
+    other.attributes_.clear();
+    other.uniformBlocks_.clear();
+}
+
+Shader& Shader::operator=(Shader&& other) noexcept {
+    if (this != &other) {
+        if (programID_ != 0) {
+            glstate::deleteProgram(programID_);
+        }
+        glDeleteShader(vertexShader_);
+        glDeleteShader(fragmentShader_);
+        programID_ = std::exchange(other.programID_, 0);
+        uniforms_ = std::move(other.uniforms_);
+        other.uniforms_.clear();
+        attributes_ = std::move(other.attributes_);
+        other.attributes_.clear();
+        attributeMask_ = std::exchange(other.attributeMask_, 0);
+        uniformBlocks_ = std::move(other.uniformBlocks_);
+        other.uniformBlocks_.clear();
+        vertexFile_ = std::move(other.vertexFile_);
+        fragmentFile_ = std::move(other.fragmentFile_);
+        defines_ = std::move(other.defines_);
+        vertexFiles_ = std::move(other.vertexFiles_);
+        fragmentFiles_ = std::move(other.fragmentFiles_);
+        vertexShader_ = std::exchange(other.vertexShader_, 0);
+        fragmentShader_ = std::exchange(other.fragmentShader_, 0);
     }
+    return *this;
 }
 
 GLuint Shader::id() const { return programID_; }
 
+void Shader::use() const { glstate::useProgram(programID_); }
+
 std::string readFile(const std::string& filename) {
     std::ifstream in(filename.c_str());
     if (!in.is_open()) {
@@ -54,57 +117,798 @@ std::string readFile(const std::string& filename) {
     return buffer;
 }
 
-GLuint loadShader(GLenum shaderType, const std::string& filename) {
+/*
+ * Append a shader file to source, with its #include "file" lines replaced by the
+ * included files, which are found relative to the including file. The defines are
+ * inserted after the #version line of the main file. #line directives keep the line
+ * numbers in compile errors right; the second number is the index of the file in files.
+ */
+static bool appendSource(const std::string& filename, const std::vector<std::string>& defines,
+                         std::vector<std::string>& files, std::string& source) {
+    if (files.size() > 64) {
+        std::cerr << "Error: Too many shader includes, circular #include? ('" << filename
+                  << "')\n";
+        return false;
+    }
+    std::string text = readFile(filename);
+    if (text.empty()) {
+        return false;
+    }
+    while (!text.empty() && text.back() == '\0') {
+        text.pop_back();
+    }
+    const std::string fileIndex = std::to_string(files.size());
+    files.push_back(filename);
+    const std::filesystem::path directory = std::filesystem::path(filename).parent_path();
+
+    size_t lineNumber = 0;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        const std::string line = text.substr(pos, end - pos);
+        pos = end + 1;
+        lineNumber++;
+
+        const size_t start = line.find_first_not_of(" \t");
+        const std::string directive = (start != std::string::npos) ? line.substr(start) : "";
+        if (directive.compare(0, 8, "#include") == 0) {
+            const size_t open = directive.find_first_of("\"<", 8);
+            const size_t close = (open != std::string::npos)
+                                     ? directive.find_first_of("\">", open + 1)
+                                     : std::string::npos;
+            if (close == std::string::npos) {
+                std::cerr << "Error: Invalid #include in shader file '" << filename << "', line "
+                          << lineNumber << "\n";
+                return false;
+            }
+            const std::string include =
+                (directory / directive.substr(open + 1, close - open - 1)).string();
+            source += "#line 1 " + std::to_string(files.size()) + "\n";
+            if (!appendSource(include, {}, files, source)) {
+                return false;
+            }
+            source += "#line " + std::to_string(lineNumber + 1) + " " + fileIndex + "\n";
+        } else {
+            source += line + "\n";
+            if (!defines.empty() && directive.compare(0, 8, "#version") == 0) {
+                // A define is either NAME or NAME=VALUE
+                for (const std::string& define : defines) {
+                    const size_t equals = define.find('=');
+                    source += "#define " + define.substr(0, equals);
+                    if (equals != std::string::npos) {
+                        source += " " + define.substr(equals + 1);
+                    }
+                    source += "\n";
+                }
+                source += "#line " + std::to_string(lineNumber + 1) + " " + fileIndex + "\n";
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Load a shader file with its includes and defines. Returns an empty string on errors.
+ * files is set to the file and the files it includes.
+ */
+static std::string loadSource(const std::string& filename, const std::vector<std::string>& defines,
+                              std::vector<std::string>& files) {
+    files.clear();
+    std::string source;
+    if (!appendSource(filename, defines, files, source)) {
+        return {};
+    }
+    return source;
+}
+
+GLuint loadShader(GLenum shaderType, const std::string& shaderSource) {
     GLuint shader = glCreateShader(shaderType);
-    std::string shaderSource = readFile(filename);
     if (!shaderSource.empty()) {
         const char* source = shaderSource.c_str();
         glShaderSource(shader, 1, &source, nullptr);
         glCompileShader(shader);
     }
+    return shader;
+}
 
+// Print the log of a shader which did not compile. Waits for the compiler to finish.
+static bool checkShader(GLuint shader, const std::string& filename) {
     GLint shaderCompiled = GL_FALSE;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &shaderCompiled);
 
     if (shaderCompiled == GL_FALSE) {
         // something went wrong, print the shader log
-        static char buf[4096] = {0};  // buffer for error messages from the GLSL compiler and linker
+        char buf[4096] = {0};  // buffer for error messages from the GLSL compiler and linker
         glGetShaderInfoLog(shader, sizeof(buf), nullptr, buf);
         std::cerr << "Shader compile error ('" << filename << "'):\n" << buf << "\n";
+        return false;
     }
+    return true;
+}
 
-    return shader;
+/*
+ * Name of the cache file for a program binary, or an empty string if program binaries
+ * are not available. The hash covers the sources and the GL driver, since a binary only
+ * works with the driver version which created it.
+ */
+static std::string binaryCacheFile(const std::string& directory, const std::string& vertexSource,
+                                   const std::string& fragmentSource) {
+    if (directory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) {
+        return {};
+    }
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats == 0) {
+        return {};
+    }
+
+    uint64_t hash = util::hashBytes(vertexSource.data(), vertexSource.size());
+    hash = util::hashBytes(fragmentSource.data(), fragmentSource.size(), hash);
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        if (value != nullptr) {
+            hash = util::hashBytes(value, std::strlen(value) + 1, hash);
+        }
+    }
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return directory + "/" + name + ".bin";
+}
+
+/*
+ * Create a program from a cached binary. Returns 0 if there is no cached binary, or if
+ * the driver rejects it, in which case the program has to be compiled from source.
+ */
+static GLuint loadProgramBinary(const std::string& cacheFile) {
+    std::vector<char> contents;
+    if (!util::readFileBytes(cacheFile, contents) || contents.size() <= sizeof(uint32_t)) {
+        return 0;
+    }
+    uint32_t format;
+    std::memcpy(&format, contents.data(), sizeof(format));
+
+    GLuint programObject = glCreateProgram();
+    glProgramBinary(programObject, format, contents.data() + sizeof(format),
+                    static_cast<GLsizei>(contents.size() - sizeof(format)));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) {
+        glDeleteProgram(programObject);
+        return 0;
+    }
+    return programObject;
+}
+
+/* Store the binary of a linked program in the cache, as its format followed by the data */
+static void saveProgramBinary(GLuint programObject, const std::string& directory,
+                              const std::string& cacheFile) {
+    GLint length = 0;
+    glGetProgramiv(programObject, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(sizeof(uint32_t) + static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(programObject, length, nullptr, &format, binary.data() + sizeof(uint32_t));
+    const uint32_t format32 = format;
+    std::memcpy(binary.data(), &format32, sizeof(format32));
+
+    // Write to a temporary file first, so that a partly written cache file is never read
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    const size_t threadHash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    const std::string tempFile = cacheFile + "." + std::to_string(threadHash);
+    std::ofstream out(tempFile, std::ios_base::out | std::ios_base::binary);
+    out.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+    out.close();
+    if (out) {
+        std::filesystem::rename(tempFile, cacheFile, ec);
+    } else {
+        std::filesystem::remove(tempFile, ec);
+    }
 }
 
 void Shader::createShader(const std::string& vertexshaderfile,
-                          const std::string& fragmentshaderfile) {
+                          const std::string& fragmentshaderfile,
+                          const std::vector<std::string>& defines) {
+    Build build = beginBuild(vertexshaderfile, fragmentshaderfile, defines);
+    setSources(build);
+    setProgram(endBuild(build));  // Save this value in the class variable
+}
+
+void Shader::setSources(const Build& build) {
+    vertexFile_ = build.vertexFile;
+    fragmentFile_ = build.fragmentFile;
+    defines_ = build.defines;
+    vertexFiles_ = build.vertexFiles;
+    fragmentFiles_ = build.fragmentFiles;
+    glDeleteShader(vertexShader_);
+    glDeleteShader(fragmentShader_);
+    vertexShader_ = 0;
+    fragmentShader_ = 0;
+}
+
+const std::vector<std::string>& Shader::vertexSourceFiles() const { return vertexFiles_; }
+
+const std::vector<std::string>& Shader::fragmentSourceFiles() const { return fragmentFiles_; }
+
+const std::vector<Shader::Attribute>& Shader::attributes() const { return attributes_; }
+
+uint32_t Shader::attributeMask() const { return attributeMask_; }
+
+const std::unordered_map<std::string, Shader::Uniform>& Shader::uniforms() const {
+    return uniforms_;
+}
+
+const std::vector<Shader::UniformBlock>& Shader::uniformBlocks() const { return uniformBlocks_; }
+
+// Number of attribute locations used by one element of an attribute, 2 to 4 for matrices
+static GLint attributeLocations(GLenum type) {
+    switch (type) {
+        case GL_FLOAT_MAT2:
+        case GL_FLOAT_MAT2x3:
+        case GL_FLOAT_MAT2x4:
+            return 2;
+        case GL_FLOAT_MAT3:
+        case GL_FLOAT_MAT3x2:
+        case GL_FLOAT_MAT3x4:
+            return 3;
+        case GL_FLOAT_MAT4:
+        case GL_FLOAT_MAT4x2:
+        case GL_FLOAT_MAT4x3:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+void Shader::setProgram(GLuint program) {
     // If a program is already stored in this object, delete it
     if (programID_ != 0) {
-        glDeleteProgram(programID_);
+        glstate::deleteProgram(programID_);
+    }
+    programID_ = program;
+    uniforms_.clear();
+    attributes_.clear();
+    attributeMask_ = 0;
+    uniformBlocks_.clear();
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) {
+        return;
+    }
+
+    // Uniforms in uniform blocks have no location and are left out
+    GLint numUniforms = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+    GLint maxLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(static_cast<size_t>(std::max(maxLength, 1)));
+    for (GLint i = 0; i < numUniforms; i++) {
+        Uniform uniform;
+        GLsizei length = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), maxLength, &length, &uniform.size,
+                           &uniform.type, name.data());
+        uniform.location = glGetUniformLocation(program, name.data());
+        if (uniform.location < 0) {
+            continue;
+        }
+        // Arrays are reported as "name[0]", and can be set as "name" too
+        std::string uniformName(name.data(), static_cast<size_t>(length));
+        const size_t bracket = uniformName.rfind("[0]");
+        if (bracket != std::string::npos && bracket + 3 == uniformName.size()) {
+            uniforms_.emplace(uniformName.substr(0, bracket), uniform);
+        }
+        uniforms_.emplace(std::move(uniformName), std::move(uniform));
+    }
+
+    // Built-in inputs like gl_VertexID have no location and are left out
+    GLint numAttributes = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &numAttributes);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name.resize(static_cast<size_t>(std::max(maxLength, 1)));
+    for (GLint i = 0; i < numAttributes; i++) {
+        Attribute attribute;
+        GLsizei length = 0;
+        glGetActiveAttrib(program, static_cast<GLuint>(i), maxLength, &length, &attribute.size,
+                          &attribute.type, name.data());
+        attribute.location = glGetAttribLocation(program, name.data());
+        if (attribute.location < 0) {
+            continue;
+        }
+        attribute.name.assign(name.data(), static_cast<size_t>(length));
+        const GLint end = attribute.location + attribute.size * attributeLocations(attribute.type);
+        for (GLint location = attribute.location; location < end && location < 32; location++) {
+            attributeMask_ |= 1u << location;
+        }
+        attributes_.push_back(std::move(attribute));
+    }
+
+    GLint numBlocks = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &numBlocks);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    name.resize(static_cast<size_t>(std::max(maxLength, 1)));
+    for (GLuint i = 0; i < static_cast<GLuint>(numBlocks); i++) {
+        UniformBlock block;
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(program, i, maxLength, &length, name.data());
+        block.name.assign(name.data(), static_cast<size_t>(length));
+        block.index = i;
+        glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+        uniformBlocks_.push_back(std::move(block));
+    }
+}
+
+/*
+ * Find a uniform in the table. Elements of arrays other than the first, like "lights[2]",
+ * are not in the table after linking and are added when they are first used.
+ */
+Shader::Uniform* Shader::findUniform(const std::string& name) {
+    auto it = uniforms_.find(name);
+    if (it != uniforms_.end()) {
+        return &it->second;
+    }
+    if (programID_ == 0 || name.empty() || name.back() != ']') {
+        return nullptr;
+    }
+    const GLint location = glGetUniformLocation(programID_, name.c_str());
+    if (location < 0) {
+        return nullptr;
+    }
+    auto first = uniforms_.find(name.substr(0, name.rfind('[')));
+    const GLenum type = (first != uniforms_.end()) ? first->second.type : 0;
+    return &uniforms_.emplace(name, Uniform{location, type, 1, {}}).first->second;
+}
+
+// Number of components of a uniform type, for the types set through GLint or GLfloat
+static size_t components(GLenum type) {
+    switch (type) {
+        case GL_FLOAT_VEC2:
+        case GL_INT_VEC2:
+        case GL_UNSIGNED_INT_VEC2:
+        case GL_BOOL_VEC2:
+            return 2;
+        case GL_FLOAT_VEC3:
+        case GL_INT_VEC3:
+        case GL_UNSIGNED_INT_VEC3:
+        case GL_BOOL_VEC3:
+            return 3;
+        case GL_FLOAT_VEC4:
+        case GL_INT_VEC4:
+        case GL_UNSIGNED_INT_VEC4:
+        case GL_BOOL_VEC4:
+        case GL_FLOAT_MAT2:
+            return 4;
+        case GL_FLOAT_MAT2x3:
+        case GL_FLOAT_MAT3x2:
+            return 6;
+        case GL_FLOAT_MAT2x4:
+        case GL_FLOAT_MAT4x2:
+            return 8;
+        case GL_FLOAT_MAT3:
+            return 9;
+        case GL_FLOAT_MAT3x4:
+        case GL_FLOAT_MAT4x3:
+            return 12;
+        case GL_FLOAT_MAT4:
+            return 16;
+        default:  // Scalars and samplers
+            return 1;
+    }
+}
+
+// Uniform types which are set through the GLfloat versions of setUniform()
+static bool isFloatType(GLenum type) {
+    switch (type) {
+        case GL_FLOAT:
+        case GL_FLOAT_VEC2:
+        case GL_FLOAT_VEC3:
+        case GL_FLOAT_VEC4:
+        case GL_FLOAT_MAT2:
+        case GL_FLOAT_MAT3:
+        case GL_FLOAT_MAT4:
+        case GL_FLOAT_MAT2x3:
+        case GL_FLOAT_MAT3x2:
+        case GL_FLOAT_MAT2x4:
+        case GL_FLOAT_MAT4x2:
+        case GL_FLOAT_MAT3x4:
+        case GL_FLOAT_MAT4x3:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Uniform types which are set through the GLint versions of setUniform() as unsigned
+static bool isUnsignedType(GLenum type) {
+    return type == GL_UNSIGNED_INT || type == GL_UNSIGNED_INT_VEC2 ||
+           type == GL_UNSIGNED_INT_VEC3 || type == GL_UNSIGNED_INT_VEC4;
+}
+
+/*
+ * Find a uniform for the setUniform() functions which take single values, which pass n
+ * values of float or integer type. A uniform of another type would have its values read
+ * past the end of the arguments, so it is ignored with a warning.
+ */
+Shader::Uniform* Shader::findUniform(const std::string& name, size_t n, bool isFloat) {
+    Uniform* uniform = findUniform(name);
+    if (uniform == nullptr || uniform->type == 0) {
+        return uniform;  // Array elements of unknown type are set as one value
+    }
+    if (components(uniform->type) != n || isFloatType(uniform->type) != isFloat) {
+        std::cerr << "Uniform '" << name << "' cannot be set with " << n
+                  << (isFloat ? " float" : " integer") << " value(s)\n";
+        return nullptr;
+    }
+    return uniform;
+}
+
+/* Remember the new value of a uniform. Returns false if it is the same as before. */
+bool Shader::changeUniform(Uniform& uniform, const void* value, size_t size) {
+    if (uniform.value.size() == size && std::memcmp(uniform.value.data(), value, size) == 0) {
+        return false;
+    }
+    const GLubyte* bytes = static_cast<const GLubyte*>(value);
+    uniform.value.assign(bytes, bytes + size);
+    return true;
+}
+
+GLint Shader::uniformLocation(const std::string& name) {
+    const Uniform* uniform = findUniform(name);
+    return (uniform != nullptr) ? uniform->location : -1;
+}
+
+void Shader::setUniform(const std::string& name, GLint value) {
+    if (Uniform* uniform = findUniform(name, 1, false)) {
+        setUniformValues(*uniform, &value, 1);
+    }
+}
+
+void Shader::setUniform(const std::string& name, GLfloat value) {
+    if (Uniform* uniform = findUniform(name, 1, true)) {
+        setUniformValues(*uniform, &value, 1);
+    }
+}
+
+void Shader::setUniform(const std::string& name, GLfloat x, GLfloat y) {
+    const GLfloat values[] = {x, y};
+    if (Uniform* uniform = findUniform(name, 2, true)) {
+        setUniformValues(*uniform, values, 1);
+    }
+}
+
+void Shader::setUniform(const std::string& name, GLfloat x, GLfloat y, GLfloat z) {
+    const GLfloat values[] = {x, y, z};
+    if (Uniform* uniform = findUniform(name, 3, true)) {
+        setUniformValues(*uniform, values, 1);
+    }
+}
+
+void Shader::setUniform(const std::string& name, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
+    const GLfloat values[] = {x, y, z, w};
+    if (Uniform* uniform = findUniform(name, 4, true)) {
+        setUniformValues(*uniform, values, 1);
+    }
+}
+
+void Shader::setUniform(const std::string& name, const GLint* values, GLsizei count) {
+    if (Uniform* uniform = findUniform(name)) {
+        setUniformValues(*uniform, values, count);
+    }
+}
+
+void Shader::setUniform(const std::string& name, const GLfloat* values, GLsizei count) {
+    if (Uniform* uniform = findUniform(name)) {
+        setUniformValues(*uniform, values, count);
+    }
+}
+
+void Shader::setUniformValues(Uniform& uniform, const GLint* values, GLsizei count) {
+    const size_t n = components(uniform.type);
+    if (!changeUniform(uniform, values, n * static_cast<size_t>(count) * sizeof(GLint))) {
+        return;
+    }
+    // With GL 4.1 the program does not have to be in use
+    const bool direct = GLEW_VERSION_4_1 || GLEW_ARB_separate_shader_objects;
+    const GLint location = uniform.location;
+    if (isUnsignedType(uniform.type)) {
+        const GLuint* uvalues = reinterpret_cast<const GLuint*>(values);
+        switch (n) {
+            case 2:
+                direct ? glProgramUniform2uiv(programID_, location, count, uvalues)
+                       : glUniform2uiv(location, count, uvalues);
+                break;
+            case 3:
+                direct ? glProgramUniform3uiv(programID_, location, count, uvalues)
+                       : glUniform3uiv(location, count, uvalues);
+                break;
+            case 4:
+                direct ? glProgramUniform4uiv(programID_, location, count, uvalues)
+                       : glUniform4uiv(location, count, uvalues);
+                break;
+            default:
+                direct ? glProgramUniform1uiv(programID_, location, count, uvalues)
+                       : glUniform1uiv(location, count, uvalues);
+                break;
+        }
+        return;
+    }
+    switch (n) {
+        case 2:
+            direct ? glProgramUniform2iv(programID_, location, count, values)
+                   : glUniform2iv(location, count, values);
+            break;
+        case 3:
+            direct ? glProgramUniform3iv(programID_, location, count, values)
+                   : glUniform3iv(location, count, values);
+            break;
+        case 4:
+            direct ? glProgramUniform4iv(programID_, location, count, values)
+                   : glUniform4iv(location, count, values);
+            break;
+        default:
+            direct ? glProgramUniform1iv(programID_, location, count, values)
+                   : glUniform1iv(location, count, values);
+            break;
+    }
+}
+
+void Shader::setUniformValues(Uniform& uniform, const GLfloat* values, GLsizei count) {
+    const size_t n = components(uniform.type);
+    if (!changeUniform(uniform, values, n * static_cast<size_t>(count) * sizeof(GLfloat))) {
+        return;
+    }
+    // With GL 4.1 the program does not have to be in use
+    const bool direct = GLEW_VERSION_4_1 || GLEW_ARB_separate_shader_objects;
+    const GLint location = uniform.location;
+    switch (uniform.type) {
+        case GL_FLOAT_VEC2:
+            direct ? glProgramUniform2fv(programID_, location, count, values)
+                   : glUniform2fv(location, count, values);
+            break;
+        case GL_FLOAT_VEC3:
+            direct ? glProgramUniform3fv(programID_, location, count, values)
+                   : glUniform3fv(location, count, values);
+            break;
+        case GL_FLOAT_VEC4:
+            direct ? glProgramUniform4fv(programID_, location, count, values)
+                   : glUniform4fv(location, count, values);
+            break;
+        case GL_FLOAT_MAT2:
+            direct ? glProgramUniformMatrix2fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix2fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT3:
+            direct ? glProgramUniformMatrix3fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix3fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT4:
+            direct ? glProgramUniformMatrix4fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix4fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT2x3:
+            direct ? glProgramUniformMatrix2x3fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix2x3fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT3x2:
+            direct ? glProgramUniformMatrix3x2fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix3x2fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT2x4:
+            direct ? glProgramUniformMatrix2x4fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix2x4fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT4x2:
+            direct ? glProgramUniformMatrix4x2fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix4x2fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT3x4:
+            direct ? glProgramUniformMatrix3x4fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix3x4fv(location, count, GL_FALSE, values);
+            break;
+        case GL_FLOAT_MAT4x3:
+            direct ? glProgramUniformMatrix4x3fv(programID_, location, count, GL_FALSE, values)
+                   : glUniformMatrix4x3fv(location, count, GL_FALSE, values);
+            break;
+        default:
+            direct ? glProgramUniform1fv(programID_, location, count, values)
+                   : glUniform1fv(location, count, values);
+            break;
+    }
+}
+
+/* Set the uniforms of a new program to the values they had in the old one */
+void Shader::restoreUniforms(const std::unordered_map<std::string, Uniform>& uniforms) {
+    for (const auto& [name, old] : uniforms) {
+        const Uniform* uniform = findUniform(name);
+        if (old.value.empty() || old.type == 0 || uniform == nullptr ||
+            uniform->type != old.type) {
+            continue;
+        }
+        const size_t elementSize = components(old.type) * sizeof(GLfloat);
+        const GLsizei count = static_cast<GLsizei>(old.value.size() / elementSize);
+        if (isFloatType(old.type)) {
+            setUniform(name, reinterpret_cast<const GLfloat*>(old.value.data()), count);
+        } else {
+            setUniform(name, reinterpret_cast<const GLint*>(old.value.data()), count);
+        }
+    }
+}
+
+/* Compile one stage from its source files. Returns 0, after printing the log, on errors. */
+GLuint Shader::compileStage(GLenum type, const std::string& filename,
+                            std::vector<std::string>& files) const {
+    const std::string source = loadSource(filename, defines_, files);
+    if (source.empty()) {
+        return 0;
+    }
+    GLuint shader = loadShader(type, source);
+    if (!checkShader(shader, filename)) {
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+void Shader::keepStages() {
+    if (vertexShader_ == 0 && !vertexFile_.empty()) {
+        std::vector<std::string> files;
+        vertexShader_ = compileStage(GL_VERTEX_SHADER, vertexFile_, files);
+    }
+    if (fragmentShader_ == 0 && !fragmentFile_.empty()) {
+        std::vector<std::string> files;
+        fragmentShader_ = compileStage(GL_FRAGMENT_SHADER, fragmentFile_, files);
+    }
+}
+
+bool Shader::reload(bool vertexChanged, bool fragmentChanged) {
+    if (vertexFile_.empty() || fragmentFile_.empty()) {
+        return false;
+    }
+
+    // Compile the changed stages, and the ones which are not kept from before
+    std::vector<std::string> vertexFiles;
+    std::vector<std::string> fragmentFiles;
+    GLuint vertexShader = vertexShader_;
+    GLuint fragmentShader = fragmentShader_;
+    if (vertexChanged || vertexShader == 0) {
+        vertexShader = compileStage(GL_VERTEX_SHADER, vertexFile_, vertexFiles);
+    }
+    if (fragmentChanged || fragmentShader == 0) {
+        fragmentShader = compileStage(GL_FRAGMENT_SHADER, fragmentFile_, fragmentFiles);
+    }
+
+    GLuint program = 0;
+    GLint linked = GL_FALSE;
+    if (vertexShader != 0 && fragmentShader != 0) {
+        program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    }
+    if (linked == GL_FALSE) {
+        if (program != 0) {
+            char buf[4096] = {0};
+            glGetProgramInfoLog(program, sizeof(buf), nullptr, buf);
+            std::cerr << "Shader program linker error:\n" << buf << "\n";
+            glDeleteProgram(program);
+        }
+        // Keep the old program, and the stages which were compiled for it
+        if (vertexShader != vertexShader_) {
+            glDeleteShader(vertexShader);
+        }
+        if (fragmentShader != fragmentShader_) {
+            glDeleteShader(fragmentShader);
+        }
+        return false;
+    }
+    glDetachShader(program, vertexShader);  // The stages are kept for the next reload
+    glDetachShader(program, fragmentShader);
+
+    if (vertexShader != vertexShader_) {
+        glDeleteShader(vertexShader_);
+        vertexShader_ = vertexShader;
+        vertexFiles_ = std::move(vertexFiles);
+    }
+    if (fragmentShader != fragmentShader_) {
+        glDeleteShader(fragmentShader_);
+        fragmentShader_ = fragmentShader;
+        fragmentFiles_ = std::move(fragmentFiles);
+    }
+
+    // Swap in the new program. Without GL 4.1 it has to be in use to set its uniforms,
+    // and if the old one was in use the new one takes its place.
+    const GLuint current = glstate::currentProgram();
+    const bool wasCurrent = programID_ != 0 && current == programID_;
+    const bool direct = GLEW_VERSION_4_1 || GLEW_ARB_separate_shader_objects;
+    std::unordered_map<std::string, Uniform> uniforms = std::move(uniforms_);
+    setProgram(program);
+    if (!direct) {
+        glstate::useProgram(program);
+    }
+    restoreUniforms(uniforms);
+    if (wasCurrent) {
+        glstate::useProgram(program);
+    } else if (!direct) {
+        glstate::useProgram(current);
+    }
+    return true;
+}
+
+/*
+ * Start compiling and linking a program, without asking for the result, so that the
+ * driver can work on it in the background. A program linked before with the same
+ * sources and driver is loaded as a binary instead.
+ */
+Shader::Build Shader::beginBuild(const std::string& vertexshaderfile,
+                                 const std::string& fragmentshaderfile,
+                                 const std::vector<std::string>& defines) {
+    Build build;
+    build.vertexFile = vertexshaderfile;
+    build.fragmentFile = fragmentshaderfile;
+    build.defines = defines;
+
+    const std::string vertexSource = loadSource(vertexshaderfile, defines, build.vertexFiles);
+    const std::string fragmentSource =
+        loadSource(fragmentshaderfile, defines, build.fragmentFiles);
+
+    build.cacheFile = binaryCacheFile(cacheDirectory_, vertexSource, fragmentSource);
+    if (!build.cacheFile.empty()) {
+        build.program = loadProgramBinary(build.cacheFile);
+        if (build.program != 0) {
+            return build;
+        }
     }
 
     // Create the vertex shader.
-    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vertexshaderfile);
-    GLuint fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentshaderfile);
+    build.vertexShader = loadShader(GL_VERTEX_SHADER, vertexSource);
+    build.fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentSource);
 
     // Create a program object and attach the two compiled shaders.
-    GLuint programObject = glCreateProgram();
-    glAttachShader(programObject, vertexShader);
-    glAttachShader(programObject, fragmentShader);
+    build.program = glCreateProgram();
+    glAttachShader(build.program, build.vertexShader);
+    glAttachShader(build.program, build.fragmentShader);
+    if (!build.cacheFile.empty()) {
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // Link the program object. The result is checked by endBuild().
+    glLinkProgram(build.program);
+    return build;
+}
 
-    // Link the program object and print out the info log.
-    glLinkProgram(programObject);
+/*
+ * Wait for the program of beginBuild() to be linked, print the logs if that failed,
+ * and store the binary in the cache if it succeeded. Returns the program object.
+ */
+GLuint Shader::endBuild(Build& build) {
+    if (build.vertexShader == 0) {
+        return build.program;  // Loaded from a binary
+    }
+
+    checkShader(build.vertexShader, build.vertexFile);
+    checkShader(build.fragmentShader, build.fragmentFile);
 
     GLint shadersLinked = GL_FALSE;
-    glGetProgramiv(programObject, GL_LINK_STATUS, &shadersLinked);
+    glGetProgramiv(build.program, GL_LINK_STATUS, &shadersLinked);
 
     if (shadersLinked == GL_FALSE) {
         char buf[4096] = {0};
-        glGetProgramInfoLog(programObject, sizeof(buf), nullptr, buf);
+        glGetProgramInfoLog(build.program, sizeof(buf), nullptr, buf);
         std::cerr << "Shader program linker error:\n" << buf << "\n";
+    } else if (!build.cacheFile.empty()) {
+        saveProgramBinary(build.program, cacheDirectory_, build.cacheFile);
     }
-    glDeleteShader(vertexShader);    // After successful linking,
-    glDeleteShader(fragmentShader);  // these are no longer needed
+    glDeleteShader(build.vertexShader);    // After successful linking,
+    glDeleteShader(build.fragmentShader);  // these are no longer needed
+    build.vertexShader = 0;
+    build.fragmentShader = 0;
 
-    programID_ = programObject;  // Save this value in the class variable
+    return build.program;
 }
+
+void Shader::setCacheDirectory(const std::string& directory) { cacheDirectory_ = directory; }
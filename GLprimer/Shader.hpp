@@ -3,7 +3,23 @@
  *
  * Usage: call createShader() to load and compile a program object
  * or use the constructor with two filenames.
- * Call glUseProgram() with the public member programID as argument.
+ * Shader files may #include "file" other files, relative to their own directory.
+ * Defines, as "NAME" or "NAME=VALUE", are inserted after the #version line, so that
+ * #ifdef can leave out features. See ShaderVariants.hpp for a cache of such variants.
+ * Linked programs are cached as program binaries in the directory set by
+ * setCacheDirectory(), so later runs with the same sources and GL driver skip
+ * compiling and linking. A binary which the driver rejects is compiled again.
+ * Call use() to use the program. It goes through the state cache in GLState.hpp.
+ * The active attributes, uniforms and uniform blocks of the program are listed when it
+ * is linked. TriangleSoup::render(shader) uses the attributes to fetch only the vertex
+ * data the program reads.
+ * Set uniforms with the setUniform() functions. The uniforms are looked up in a table
+ * made when the program is linked, and a value which is the same as the one set
+ * last time is not passed to OpenGL again, so do not mix them with glUniform*() calls
+ * for the same uniforms. Without GL 4.1 or ARB_separate_shader_objects, the program
+ * must be in use when uniforms are set.
+ * reload() compiles the shaders again from their files, for editing them while the
+ * program runs. See ShaderWatcher.hpp.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2014
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -13,7 +29,10 @@
 #pragma once
 
 #include <GLFW/glfw3.h>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class Shader {
 public:
@@ -21,16 +40,137 @@ public:
     Shader();
 
     // Constructor to create, load and compile a Shader program in one blow.
-    Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile);
+    Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile,
+           const std::vector<std::string>& defines = {});
 
     // Destructor
     ~Shader();
 
+    // A Shader owns its program object. It can be moved but not copied.
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+    Shader(Shader&& other) noexcept;
+    Shader& operator=(Shader&& other) noexcept;
+
     // createShader() - create, load, compile and link the GLSL shader objects.
-    void createShader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile);
+    void createShader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile,
+                      const std::vector<std::string>& defines = {});
 
     GLuint id() const;
 
+    // Use the program for rendering, unless it is already in use
+    void use() const;
+
+    // An active vertex shader input
+    struct Attribute {
+        std::string name;
+        GLint location;
+        GLenum type;  // GL_FLOAT_VEC3 etc
+        GLint size;   // Number of array elements, 1 if not an array
+    };
+
+    // An active uniform, with the value it was last set to
+    struct Uniform {
+        GLint location;
+        GLenum type;
+        GLint size;                  // Number of array elements, 1 if not an array
+        std::vector<GLubyte> value;  // Empty until the uniform is set
+    };
+
+    // An active uniform block
+    struct UniformBlock {
+        std::string name;
+        GLuint index;
+        GLint dataSize;  // Bytes of buffer data the block reads
+    };
+
+    const std::vector<Attribute>& attributes() const;
+    // Bit i is set if the program reads the vertex attribute at location i
+    uint32_t attributeMask() const;
+    // Uniforms outside blocks. Arrays are listed both as "name" and "name[0]".
+    const std::unordered_map<std::string, Uniform>& uniforms() const;
+    const std::vector<UniformBlock>& uniformBlocks() const;
+
+    // returns the location of an active uniform, or -1 like glGetUniformLocation()
+    GLint uniformLocation(const std::string& name);
+
+    // Set uniforms. Names which are not active uniforms are ignored, like location -1.
+    // Use the GLint versions for int, unsigned int, bool and sampler uniforms. The
+    // versions with single values warn and do nothing if the uniform has another type.
+    void setUniform(const std::string& name, GLint value);
+    void setUniform(const std::string& name, GLfloat value);
+    void setUniform(const std::string& name, GLfloat x, GLfloat y);
+    void setUniform(const std::string& name, GLfloat x, GLfloat y, GLfloat z);
+    void setUniform(const std::string& name, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+    // Arrays of count values, of the type of the uniform (vec3, mat4, ...)
+    void setUniform(const std::string& name, const GLint* values, GLsizei count = 1);
+    void setUniform(const std::string& name, const GLfloat* values, GLsizei count = 1);
+
+    // Compile the stages whose files changed again and link them with the compiled other
+    // stage. The program is replaced only if that works, otherwise it is kept and the
+    // errors are printed. Uniforms keep their values. Returns true if it was replaced.
+    bool reload(bool vertexChanged, bool fragmentChanged);
+
+    // The files the vertex and fragment shaders were loaded from, with their includes
+    const std::vector<std::string>& vertexSourceFiles() const;
+    const std::vector<std::string>& fragmentSourceFiles() const;
+
+    // Set the directory for cached program binaries (default "shadercache").
+    // Empty disables the cache.
+    static void setCacheDirectory(const std::string& directory);
+
 private:
+    // A program on its way from the source files to a linked program object
+    struct Build {
+        std::string vertexFile;
+        std::string fragmentFile;
+        std::vector<std::string> defines;
+        // The files of each stage, with their includes
+        std::vector<std::string> vertexFiles;
+        std::vector<std::string> fragmentFiles;
+        std::string cacheFile;      // Program binary cache file, empty if not cached
+        GLuint vertexShader = 0;    // 0 if the program was loaded from a binary
+        GLuint fragmentShader = 0;
+        GLuint program = 0;
+    };
+
+    // Compile and link without waiting for the result, then wait for it and check it
+    static Build beginBuild(const std::string& vertexshaderfile,
+                            const std::string& fragmentshaderfile,
+                            const std::vector<std::string>& defines);
+    static GLuint endBuild(Build& build);
+
+    // Take ownership of a linked program, and list its attributes, uniforms and blocks
+    void setProgram(GLuint program);
+    Uniform* findUniform(const std::string& name);
+    Uniform* findUniform(const std::string& name, size_t n, bool isFloat);
+    void setUniformValues(Uniform& uniform, const GLint* values, GLsizei count);
+    void setUniformValues(Uniform& uniform, const GLfloat* values, GLsizei count);
+    void restoreUniforms(const std::unordered_map<std::string, Uniform>& uniforms);
+    bool changeUniform(Uniform& uniform, const void* value, size_t size);
+
+    // Remember the files of a build for reload(), and drop the stages kept for it
+    void setSources(const Build& build);
+    // Compile the stages which are not kept yet, so that reload() compiles only one
+    void keepStages();
+    GLuint compileStage(GLenum type, const std::string& filename,
+                        std::vector<std::string>& files) const;
+
+    friend class ShaderBatch;
+    friend class ShaderWatcher;
+
+    static std::string cacheDirectory_;
+
     GLuint programID_;
+    std::unordered_map<std::string, Uniform> uniforms_;
+    std::vector<Attribute> attributes_;
+    uint32_t attributeMask_;
+    std::vector<UniformBlock> uniformBlocks_;
+    std::string vertexFile_;
+    std::string fragmentFile_;
+    std::vector<std::string> defines_;
+    std::vector<std::string> vertexFiles_;
+    std::vector<std::string> fragmentFiles_;
+    GLuint vertexShader_;    // Compiled stages kept for reload(), 0 if not kept
+    GLuint fragmentShader_;
 };
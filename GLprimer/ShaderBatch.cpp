@@ -0,0 +1,215 @@
+/*
+ * Compilation of shader programs in parallel, by the driver or by worker threads.
+ *
+ * GLEW does not know GL_KHR_parallel_shader_compile, so its entry point is loaded
+ * through GLFW. The ARB version of the extension has the same tokens.
+ *
+ * This code is in the public domain.
+ */
+#include "ShaderBatch.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+ShaderBatch::ShaderBatch(GLFWwindow* shareWindow, unsigned numThreads) : parallel_(false) {
+    // The KHR and ARB functions have the same signature
+    PFNGLMAXSHADERCOMPILERTHREADSARBPROC maxShaderCompilerThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+        maxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSARBPROC>(
+            glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        maxShaderCompilerThreads = glMaxShaderCompilerThreadsARB;
+    }
+    if (maxShaderCompilerThreads != nullptr) {
+        maxShaderCompilerThreads(0xFFFFFFFF);  // Let the driver use as many as it likes
+        parallel_ = true;
+        return;
+    }
+    if (shareWindow == nullptr) {
+        return;
+    }
+
+    if (numThreads == 0) {
+        // Leave one hardware thread for rendering. Every thread needs a context of its own.
+        numThreads = std::min(std::max(std::thread::hardware_concurrency(), 2u) - 1, 4u);
+    }
+    // The contexts must match the one of the shared window
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR,
+                   glfwGetWindowAttrib(shareWindow, GLFW_CONTEXT_VERSION_MAJOR));
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR,
+                   glfwGetWindowAttrib(shareWindow, GLFW_CONTEXT_VERSION_MINOR));
+    glfwWindowHint(GLFW_OPENGL_PROFILE, glfwGetWindowAttrib(shareWindow, GLFW_OPENGL_PROFILE));
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT,
+                   glfwGetWindowAttrib(shareWindow, GLFW_OPENGL_FORWARD_COMPAT));
+    for (unsigned i = 0; i < numThreads; i++) {
+        GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, shareWindow);
+        if (window == nullptr) {
+            std::cerr << "Could not create a shared context, compiling shaders on one thread\n";
+            break;
+        }
+        windows_.push_back(window);
+    }
+    glfwDefaultWindowHints();
+    for (GLFWwindow* window : windows_) {
+        threads_.emplace_back(&ShaderBatch::worker, this, window);
+    }
+}
+
+ShaderBatch::~ShaderBatch() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    workAvailable_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+    for (GLFWwindow* window : windows_) {
+        glfwDestroyWindow(window);
+    }
+
+    // Programs which were never collected are not needed any more
+    for (std::vector<Job>* jobs : {&building_, &done_}) {
+        for (Job& job : *jobs) {
+            glDeleteShader(job.build.vertexShader);
+            glDeleteShader(job.build.fragmentShader);
+            glDeleteProgram(job.build.program);
+        }
+    }
+}
+
+ShaderBatch::Handle ShaderBatch::add(const std::string& vertexshaderfile,
+                                     const std::string& fragmentshaderfile,
+                                     const std::vector<std::string>& defines) {
+    Job job;
+    job.shader = std::make_shared<Shader>();
+    job.vertexFile = vertexshaderfile;
+    job.fragmentFile = fragmentshaderfile;
+    job.defines = defines;
+    Handle shader = job.shader;
+    queued_.push_back(std::move(job));
+    return shader;
+}
+
+/* Hand queued programs to the driver or to the workers, without waiting for any of them */
+void ShaderBatch::submit() {
+    if (queued_.empty()) {
+        return;
+    }
+    if (!threads_.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (Job& job : queued_) {
+                workQueue_.push_back(std::move(job));
+            }
+        }
+        queued_.clear();
+        workAvailable_.notify_all();
+        return;
+    }
+    for (Job& job : queued_) {
+        job.build = Shader::beginBuild(job.vertexFile, job.fragmentFile, job.defines);
+        building_.push_back(std::move(job));
+    }
+    queued_.clear();
+}
+
+/* Compile programs in a context which shares objects with the rendering context */
+void ShaderBatch::worker(GLFWwindow* window) {
+    glfwMakeContextCurrent(window);
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        workAvailable_.wait(lock, [this] { return stop_ || !workQueue_.empty(); });
+        if (stop_) {
+            break;
+        }
+        Job job = std::move(workQueue_.front());
+        workQueue_.pop_front();
+        working_++;
+        lock.unlock();
+
+        job.build = Shader::beginBuild(job.vertexFile, job.fragmentFile, job.defines);
+        Shader::endBuild(job.build);
+        // Make sure the program is complete before another context uses it
+        glFinish();
+
+        lock.lock();
+        working_--;
+        done_.push_back(std::move(job));
+        jobDone_.notify_all();
+    }
+    lock.unlock();
+    glfwMakeContextCurrent(nullptr);
+}
+
+/* Give finished programs to their Shader objects */
+void ShaderBatch::collect(std::vector<Job>& jobs) {
+    for (Job& job : jobs) {
+        job.shader->setSources(job.build);
+        job.shader->setProgram(job.build.program);
+    }
+    jobs.clear();
+}
+
+bool ShaderBatch::update() {
+    std::vector<Job> ready;
+    if (!threads_.empty()) {
+        submit();
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready.swap(done_);
+    } else if (parallel_) {
+        submit();
+        for (size_t i = 0; i < building_.size();) {
+            GLint completed = GL_TRUE;
+            if (building_[i].build.vertexShader != 0) {
+                glGetProgramiv(building_[i].build.program, GL_COMPLETION_STATUS_KHR, &completed);
+            }
+            if (completed == GL_TRUE) {
+                Shader::endBuild(building_[i].build);
+                ready.push_back(std::move(building_[i]));
+                building_.erase(building_.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    } else if (!queued_.empty()) {
+        // Without parallel compile, compiling and linking block until they are done,
+        // so only one program is built per call, to keep the frame time down
+        Job job = std::move(queued_.front());
+        queued_.erase(queued_.begin());
+        job.build = Shader::beginBuild(job.vertexFile, job.fragmentFile, job.defines);
+        Shader::endBuild(job.build);
+        ready.push_back(std::move(job));
+    }
+    collect(ready);
+    return pending() == 0;
+}
+
+void ShaderBatch::finish() {
+    submit();
+
+    if (!threads_.empty()) {
+        std::vector<Job> ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            jobDone_.wait(lock, [this] { return workQueue_.empty() && working_ == 0; });
+            ready.swap(done_);
+        }
+        collect(ready);
+        return;
+    }
+    for (Job& job : building_) {
+        Shader::endBuild(job.build);
+    }
+    collect(building_);
+}
+
+size_t ShaderBatch::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_.size() + building_.size() + workQueue_.size() + working_ + done_.size();
+}
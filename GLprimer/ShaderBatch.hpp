@@ -0,0 +1,94 @@
+/*
+ * Compilation of many shader programs at once, for a shorter startup.
+ *
+ * Usage: Create a ShaderBatch after the OpenGL context and call add() for each program.
+ *        The returned Shader has id() == 0 until its program is ready. Call update()
+ *        once per frame to pick up finished programs without blocking, or finish() to
+ *        wait for all of them.
+ *        All programs are submitted to the driver before any of them is checked, since
+ *        asking for the compile or link status waits for the compiler. With
+ *        GL_KHR_parallel_shader_compile (or the ARB version) the driver compiles them
+ *        on its own threads, and GL_COMPLETION_STATUS_KHR tells which are done.
+ *        Without it, pass the window to the constructor to compile on worker threads
+ *        with hidden windows whose contexts share objects with it. Otherwise
+ *        update() compiles and links one program per call, and finish() the rest.
+ *        Destroy the ShaderBatch before the OpenGL context.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Shader.hpp"
+
+class ShaderBatch {
+public:
+    using Handle = std::shared_ptr<Shader>;
+
+    /*
+     * shareWindow is used only without parallel shader compile in the driver, to
+     * create numThreads hidden windows for the worker threads. numThreads = 0 uses one
+     * per hardware thread, minus one for rendering, and at most four.
+     * Must be called on the main thread, which GLFW requires for creating windows.
+     * Resets the GLFW window hints to their defaults.
+     */
+    explicit ShaderBatch(GLFWwindow* shareWindow = nullptr, unsigned numThreads = 0);
+    ~ShaderBatch();
+
+    ShaderBatch(const ShaderBatch&) = delete;
+    ShaderBatch& operator=(const ShaderBatch&) = delete;
+
+    // Queue a program for compilation. The handle holds no program until it is ready.
+    Handle add(const std::string& vertexshaderfile, const std::string& fragmentshaderfile,
+               const std::vector<std::string>& defines = {});
+
+    // Submit queued programs and collect the ones that are ready. Does not block, except
+    // to build one program when neither the driver nor worker threads compile in parallel.
+    // Returns true when no programs are pending.
+    bool update();
+
+    // Submit queued programs and wait until all of them are ready
+    void finish();
+
+    // Number of programs which are not yet ready
+    size_t pending() const;
+
+private:
+    struct Job {
+        Handle shader;
+        std::string vertexFile;
+        std::string fragmentFile;
+        std::vector<std::string> defines;
+        Shader::Build build;
+    };
+
+    void submit();
+    void worker(GLFWwindow* window);
+    void collect(std::vector<Job>& jobs);
+
+    bool parallel_;  // The driver compiles in the background
+
+    // Compiled on the rendering thread
+    std::vector<Job> queued_;
+    std::vector<Job> building_;
+
+    // Compiled by worker threads with shared contexts
+    std::vector<GLFWwindow*> windows_;
+    std::vector<std::thread> threads_;
+    mutable std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable jobDone_;
+    std::deque<Job> workQueue_;
+    std::vector<Job> done_;
+    size_t working_ = 0;
+    bool stop_ = false;
+};
@@ -0,0 +1,33 @@
+/*
+ * Lazily compiled shader variants
+ *
+ * This code is in the public domain.
+ */
+#include "ShaderVariants.hpp"
+
+#include <algorithm>
+
+ShaderVariants::ShaderVariants(const std::string& vertexshaderfile,
+                               const std::string& fragmentshaderfile)
+    : vertexFile_(vertexshaderfile), fragmentFile_(fragmentshaderfile) {}
+
+Shader& ShaderVariants::get(std::vector<std::string> defines) {
+    // The same defines in any order give the same variant
+    std::sort(defines.begin(), defines.end());
+    defines.erase(std::unique(defines.begin(), defines.end()), defines.end());
+    std::string key;
+    for (const std::string& define : defines) {
+        key += define;
+        key += '\n';
+    }
+
+    std::unique_ptr<Shader>& variant = variants_[key];
+    if (variant == nullptr) {
+        variant = std::make_unique<Shader>(vertexFile_, fragmentFile_, defines);
+    }
+    return *variant;
+}
+
+size_t ShaderVariants::size() const { return variants_.size(); }
+
+void ShaderVariants::clear() { variants_.clear(); }
@@ -0,0 +1,40 @@
+/*
+ * Variants of a shader program, compiled with different sets of defines.
+ *
+ * Usage: Create a ShaderVariants with the vertex and fragment shader files, and call
+ *        get() with the defines a material needs, like {"TEXTURED", "SPECULAR"}, each
+ *        time it is drawn. A variant is compiled the first time it is asked for, and
+ *        kept for later calls, so a material without specular highlights runs a
+ *        program which does not compute them. The order of the defines does not matter.
+ *        With the program binary cache of Shader, variants compiled in an earlier run
+ *        are loaded without compiling. Call clear() after editing the shader files.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.hpp"
+
+class ShaderVariants {
+public:
+    ShaderVariants(const std::string& vertexshaderfile, const std::string& fragmentshaderfile);
+
+    // returns the variant for a set of defines ("NAME" or "NAME=VALUE"), compiling it if needed
+    Shader& get(std::vector<std::string> defines = {});
+
+    // Number of variants compiled so far
+    size_t size() const;
+
+    // Delete all variants, so they are compiled again from the files
+    void clear();
+
+private:
+    std::string vertexFile_;
+    std::string fragmentFile_;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> variants_;  // By sorted defines
+};
@@ -0,0 +1,137 @@
+/*
+ * Reloading of shaders when their files change
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "ShaderWatcher.hpp"
+
+#include <algorithm>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Time between checks of the modification times, without inotify
+static const std::chrono::milliseconds pollInterval(250);
+
+// Files are compared by their normalized paths, "shaders/../common.glsl" is "common.glsl"
+static std::string normalPath(const std::string& filename) {
+    return std::filesystem::path(filename).lexically_normal().string();
+}
+
+ShaderWatcher::ShaderWatcher() : lastPoll_(std::chrono::steady_clock::now()), inotify_(-1) {
+#ifdef __linux__
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher() {
+#ifdef __linux__
+    if (inotify_ >= 0) {
+        close(inotify_);
+    }
+#endif
+}
+
+void ShaderWatcher::watch(Shader& shader) {
+    if (std::find(shaders_.begin(), shaders_.end(), &shader) != shaders_.end()) {
+        return;
+    }
+    shaders_.push_back(&shader);
+    shader.keepStages();
+    addFiles(shader);
+}
+
+void ShaderWatcher::unwatch(Shader& shader) {
+    shaders_.erase(std::remove(shaders_.begin(), shaders_.end(), &shader), shaders_.end());
+}
+
+/* Watch the files of a shader which are not watched yet, includes may have been added */
+void ShaderWatcher::addFiles(const Shader& shader) {
+    for (const auto* files : {&shader.vertexSourceFiles(), &shader.fragmentSourceFiles()}) {
+        for (const std::string& file : *files) {
+            const std::string path = normalPath(file);
+            if (files_.count(path) != 0) {
+                continue;
+            }
+            std::error_code ec;
+            files_[path] = std::filesystem::last_write_time(path, ec);
+#ifdef __linux__
+            // Watch the directory, since editors often save a new file and rename it
+            if (inotify_ >= 0) {
+                std::string directory = std::filesystem::path(path).parent_path().string();
+                if (directory.empty()) {
+                    directory = ".";
+                }
+                const int wd = inotify_add_watch(inotify_, directory.c_str(),
+                                                 IN_CLOSE_WRITE | IN_MOVED_TO);
+                if (wd >= 0) {
+                    directories_[wd] = directory;
+                }
+            }
+#endif
+        }
+    }
+}
+
+int ShaderWatcher::update() {
+    std::unordered_set<std::string> changed;
+#ifdef __linux__
+    if (inotify_ >= 0) {
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotify_, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t pos = 0; pos < length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(&buffer[pos]);
+                pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                auto directory = directories_.find(event->wd);
+                if (event->len > 0 && directory != directories_.end()) {
+                    const std::string path =
+                        normalPath((std::filesystem::path(directory->second) / event->name)
+                                       .string());
+                    if (files_.count(path) != 0) {
+                        changed.insert(path);
+                    }
+                }
+            }
+        }
+    }
+#endif
+    const auto now = std::chrono::steady_clock::now();
+    if (inotify_ < 0 && now - lastPoll_ >= pollInterval) {
+        lastPoll_ = now;
+        for (auto& [path, time] : files_) {
+            std::error_code ec;
+            const auto modified = std::filesystem::last_write_time(path, ec);
+            if (!ec && modified != time) {
+                time = modified;
+                changed.insert(path);
+            }
+        }
+    }
+    if (changed.empty()) {
+        return 0;
+    }
+
+    auto uses = [&changed](const std::vector<std::string>& files) {
+        return std::any_of(files.begin(), files.end(), [&changed](const std::string& file) {
+            return changed.count(normalPath(file)) != 0;
+        });
+    };
+    int reloaded = 0;
+    for (Shader* shader : shaders_) {
+        const bool vertexChanged = uses(shader->vertexSourceFiles());
+        const bool fragmentChanged = uses(shader->fragmentSourceFiles());
+        if (vertexChanged || fragmentChanged) {
+            if (shader->reload(vertexChanged, fragmentChanged)) {
+                reloaded++;
+            }
+            addFiles(*shader);
+        }
+    }
+    return reloaded;
+}
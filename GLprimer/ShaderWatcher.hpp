@@ -0,0 +1,49 @@
+/*
+ * Reloading of shaders when their files change, to edit shaders while the program runs.
+ *
+ * Usage: Create a ShaderWatcher after the OpenGL context, call watch() for each Shader
+ *        once it has a program, and call update() once per frame. When a shader file,
+ *        or a file it includes, is saved, only the stage which uses it is compiled again,
+ *        and it is linked with the compiled other stage, see Shader::reload(). If that
+ *        fails, the errors are printed and the Shader keeps its old program.
+ *        On Linux, changes are reported by inotify. Elsewhere the modification times of
+ *        the files are compared a few times per second.
+ *        Call unwatch() before a watched Shader is destroyed or moved.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.hpp"
+
+class ShaderWatcher {
+public:
+    ShaderWatcher();
+    ~ShaderWatcher();
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // Start watching the files of a shader. Compiles its stages, to keep them for reloads.
+    void watch(Shader& shader);
+    void unwatch(Shader& shader);
+
+    // Reload the shaders whose files changed. Returns the number of reloaded shaders.
+    int update();
+
+private:
+    void addFiles(const Shader& shader);
+
+    std::vector<Shader*> shaders_;
+    // Watched files, and their modification times for polling
+    std::unordered_map<std::string, std::filesystem::file_time_type> files_;
+    std::chrono::steady_clock::time_point lastPoll_;
+    int inotify_;  // inotify file descriptor, -1 if the files are polled
+    std::unordered_map<int, std::string> directories_;  // Directories by watch descriptor
+};
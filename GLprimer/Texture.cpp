@@ -9,22 +9,85 @@
 #include <cstdio>   // For file I/O
 #include <cstring>  // For memcmp()
 #include <iostream>
-#include <fstream>
 #include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <unordered_set>
+#include <utility>
 
 #include <GL/glew.h>
 
 #include "Texture.hpp"
+#include "GLState.hpp"
+#include "KTXFile.hpp"
+#include "TextureCompression.hpp"
+#include "Utilities.hpp"
+
+std::string Texture::cacheDirectory_ = "texturecache";
+mipmap::Filter Texture::mipmapFilter_ = mipmap::Filter::Box;
+size_t Texture::memoryBudget_ = 0;
+size_t Texture::allocatedMemory_ = 0;
+std::unordered_set<Texture*> Texture::textures_;
 
 /* Constructor to load and intialize the texture all at once */
-Texture::Texture(const std::string& filename) : textureID_(0) { createTexture(filename); }
+Texture::Texture(const std::string& filename, bool srgb, Compression compression)
+    : textureID_(0)
+    , internalFormat_(0)
+    , levels_(0)
+    , memoryUsage_(0)
+    , droppedLevels_(0)
+    , usage_(0)
+    , srgb_(false)
+    , compression_(Compression::None) {
+    textures_.insert(this);
+    createTexture(filename, srgb, compression);
+}
 
 /* Destructor */
 Texture::~Texture() {
     if (textureID_ != 0) {
-        glDeleteTextures(1, &textureID_);
+        glstate::deleteTextures(1, &textureID_);
     }
+    allocatedMemory_ -= memoryUsage_;
+    textures_.erase(this);
+}
+
+Texture::Texture(Texture&& other) noexcept
+    : textureID_(std::exchange(other.textureID_, 0))
+    , internalFormat_(std::exchange(other.internalFormat_, 0))
+    , levels_(std::exchange(other.levels_, 0))
+    , memoryUsage_(std::exchange(other.memoryUsage_, 0))
+    , droppedLevels_(std::exchange(other.droppedLevels_, 0))
+    , usage_(std::exchange(other.usage_, 0))
+    , filename_(std::exchange(other.filename_, {}))
+    , srgb_(other.srgb_)
+    , compression_(other.compression_)
+    , image_(std::exchange(other.image_, {})) {
+    textures_.insert(this);
+}
+
+Texture& Texture::operator=(Texture&& other) noexcept {
+    if (this != &other) {
+        if (textureID_ != 0) {
+            glstate::deleteTextures(1, &textureID_);
+        }
+        allocatedMemory_ -= memoryUsage_;
+        textureID_ = std::exchange(other.textureID_, 0);
+        internalFormat_ = std::exchange(other.internalFormat_, 0);
+        levels_ = std::exchange(other.levels_, 0);
+        memoryUsage_ = std::exchange(other.memoryUsage_, 0);
+        droppedLevels_ = std::exchange(other.droppedLevels_, 0);
+        usage_ = std::exchange(other.usage_, 0);
+        filename_ = std::exchange(other.filename_, {});
+        srgb_ = other.srgb_;
+        compression_ = other.compression_;
+        image_ = std::exchange(other.image_, {});
+    }
+    return *this;
 }
 
 GLuint Texture::id() const { return textureID_; }
@@ -35,48 +98,132 @@ GLuint Texture::height() const { return image_.height; }
 
 GLuint Texture::type() const { return image_.type; }
 
+GLenum Texture::internalFormat() const { return internalFormat_; }
+
+GLsizei Texture::levels() const { return levels_; }
+
+size_t Texture::memoryUsage() const { return memoryUsage_; }
+
 /*
- * Open and test the file to make sure it is a valid TGA file
+ * Sized internal format matching the channels of the source image, so that no
+ * memory is spent on channels the image does not have. There are no sRGB formats
+ * for one or two channels, so grayscale images are always stored as linear.
+ */
+static GLenum sizedInternalFormat(GLuint type, bool srgb) {
+    switch (type) {
+        case GL_RED:
+            return GL_R8;
+        case GL_RG:
+            return GL_RG8;
+        case GL_RGB:
+            return srgb ? GL_SRGB8 : GL_RGB8;
+        default:
+            return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+}
+
+/* Bytes per texel of the sized internal formats returned by sizedInternalFormat() */
+static size_t bytesPerTexel(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_R8:
+            return 1;
+        case GL_RG8:
+            return 2;
+        case GL_RGB8:
+        case GL_SRGB8:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+/*
+ * Decode RLE compressed TGA pixel data from src to dst.
  *
- * roughly based on NeHe's TGA loading code
+ * Each packet starts with a header byte. If the top bit is set, the packet is a run
+ * of (header & 0x7f) + 1 copies of the single pixel which follows. Otherwise, the
+ * packet holds (header + 1) raw pixels. Runs are filled by copying the pixel once
+ * and then doubling the filled range with memcpy, raw packets with a single memcpy.
+ * Returns false if the data ends prematurely. Packets overflowing the image are clipped.
  */
-Texture::ImageData Texture::loadUncompressedTGA(const std::string& filename) const {
-    std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+static bool decodeRLE(const GLubyte* src, size_t srcSize, GLubyte* dst, size_t imageSize,
+                      size_t bytesPerPixel) {
+    const GLubyte* srcEnd = src + srcSize;
+    GLubyte* dstEnd = dst + imageSize;
 
-    if (!in.is_open()) {
+    while (dst < dstEnd) {
+        if (src >= srcEnd) {
+            return false;
+        }
+        const GLubyte packet = *src++;
+        const size_t count = (packet & 0x7f) + 1;
+        const size_t bytes = std::min(count * bytesPerPixel, static_cast<size_t>(dstEnd - dst));
+
+        if (packet & 0x80) {  // Run-length packet: one pixel repeated count times
+            if (static_cast<size_t>(srcEnd - src) < bytesPerPixel) {
+                return false;
+            }
+            if (bytesPerPixel == 1) {
+                std::memset(dst, *src, bytes);
+            } else {
+                size_t filled = std::min(bytesPerPixel, bytes);
+                std::memcpy(dst, src, filled);
+                while (filled < bytes) {
+                    const size_t chunk = std::min(filled, bytes - filled);
+                    std::memcpy(dst + filled, dst, chunk);
+                    filled += chunk;
+                }
+            }
+            src += bytesPerPixel;
+        } else {  // Raw packet: count literal pixels
+            if (static_cast<size_t>(srcEnd - src) < count * bytesPerPixel) {
+                return false;
+            }
+            std::memcpy(dst, src, bytes);
+            src += count * bytesPerPixel;
+        }
+        dst += bytes;
+    }
+    return true;
+}
+
+/*
+ * Test the mapped file to make sure it is a valid TGA file, and decode it.
+ * The pixels of an uncompressed file are not copied: image.pixels points into the
+ * mapping, so the file has to stay mapped while the image is used.
+ *
+ * roughly based on NeHe's TGA loading code
+ */
+Texture::ImageData Texture::loadTGA(const std::string& filename, const MappedFile& file) {
+    if (!file.isOpen()) {
         std::cerr << "Could not open texture file ('" << filename << "')\n";
         return {};  // return an empty image
     }
+    const GLubyte* data = file.data();
 
-    // Attempt to read 12 byte file header
-    std::array<char, 12> tgaheader;
-
-    in.read(tgaheader.data(), sizeof(tgaheader));
-    if (in.fail()) {
+    // 12 byte file header, followed by the 6 useful bytes of the TGA header
+    std::array<GLubyte, 12> tgaheader;
+    std::array<GLubyte, 6> header;
+    if (file.size() < sizeof(tgaheader) + sizeof(header)) {
         std::cerr << "Could not read file header ('" << filename << "')\n";
         return {};  // return an empty image
     }
+    std::memcpy(tgaheader.data(), data, sizeof(tgaheader));
+    std::memcpy(header.data(), data + sizeof(tgaheader), sizeof(header));
 
-    // headers for compressed and uncompressed TGAs
-    const std::array<char, 12> uncompressedTGA = {{0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
-    const std::array<char, 12> compressedTGA = {{0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    // headers for compressed and uncompressed TGAs, in color and grayscale
+    const std::array<GLubyte, 12> uncompressedTGA = {{0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    const std::array<GLubyte, 12> compressedTGA = {{0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    const std::array<GLubyte, 12> uncompressedGrayTGA = {{0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    const std::array<GLubyte, 12> compressedGrayTGA = {{0, 0, 11, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
 
-    if (tgaheader == compressedTGA) {
-        std::cerr << "RLE compressed TGA files are not supported ('" << filename << "')\n";
-        return {};
-    } else if (tgaheader != uncompressedTGA) {
+    const bool compressed = (tgaheader == compressedTGA || tgaheader == compressedGrayTGA);
+    const bool grayscale = (tgaheader == uncompressedGrayTGA || tgaheader == compressedGrayTGA);
+    if (!compressed && !grayscale && tgaheader != uncompressedTGA) {
         std::cerr << "Unsupported image file format ('" << filename << "')\n";
         return {};
     }
 
-    std::array<GLubyte, 6> header;  // First 6 useful bytes from the header
-    // std::ifstream::read() only reads 'char', thus we need a type cast for tga.header
-    in.read(reinterpret_cast<char*>(header.data()), sizeof(header));
-    if (in.fail()) {
-        std::cerr << "Could not read TGA header ('" << filename << "')\n";
-        return {};
-    }
-
     ImageData image;
 
     // Determine the TGA width (highbyte*256 + lowbyte)
@@ -94,71 +241,589 @@ Texture::ImageData Texture::loadUncompressedTGA(const std::string& filename) con
     const GLuint bpp = header[4];
     // Compute the number of BYTES per pixel
     const GLuint bytesPerPixel = (bpp / 8);
-    // Compute the total amount of memory needed
-    const GLuint imageSize = (bytesPerPixel * image.width * image.height);
+    // Compute the total amount of memory needed, which can exceed 32 bits
+    const size_t imageSize =
+        static_cast<size_t>(bytesPerPixel) * static_cast<size_t>(image.width) * image.height;
 
-    switch (bpp) {
-        case 24:
+    // Grayscale images have 1 or 2 bytes per pixel (gray, alpha), color images 3 or 4
+    const bool validDepth = grayscale ? (bpp == 8 || bpp == 16) : (bpp == 24 || bpp == 32);
+    if (!validDepth) {
+        std::cerr << "Unsupported number of bits per pixel (" << bpp << ") ('" << filename
+                  << "')\n";
+        return {};
+    }
+
+    switch (bytesPerPixel) {
+        case 1:
+            image.type = GL_RED;
+            image.format = GL_RED;
+            std::cout << "Texture type is GL_RED ('" << filename << "')\n";
+            break;
+        case 2:
+            image.type = GL_RG;
+            image.format = GL_RG;
+            std::cout << "Texture type is GL_RG ('" << filename << "')\n";
+            break;
+        case 3:
             image.type = GL_RGB;
+            image.format = GL_BGR;
             std::cout << "Texture type is GL_RGB ('" << filename << "')\n";
             break;
-        case 32:
+        default:
             image.type = GL_RGBA;
-            std::cout << "Texture type is GL_RGB ('" << filename << "')\n";
+            image.format = GL_BGRA;
+            std::cout << "Texture type is GL_RGBA ('" << filename << "')\n";
             break;
-        default:
-            std::cerr << "Unsupported number of bits per pixel (" << bpp << ") ('" << filename
-                      << "')\n";
+    }
+
+    const GLubyte* pixels = data + sizeof(tgaheader) + sizeof(header);
+    const size_t pixelBytes = file.size() - sizeof(tgaheader) - sizeof(header);
+    if (compressed) {
+        // Each packet has at least 1 + bytesPerPixel bytes and gives at most 128 pixels, so
+        // a larger image cannot be decoded from the file. Check before allocating memory.
+        if (pixelBytes / (1 + bytesPerPixel) * 128 * bytesPerPixel < imageSize) {
+            std::cerr << "Could not read RLE image data ('" << filename << "')\n";
             return {};
+        }
+        // Decode the RLE packets straight from the mapped file
+        image.data.resize(imageSize);  // Allocate memory for image data
+        if (!decodeRLE(pixels, pixelBytes, image.data.data(), imageSize, bytesPerPixel)) {
+            std::cerr << "Could not read RLE image data ('" << filename << "')\n";
+            return {};
+        }
+        image.pixels = image.data.data();
+    } else {
+        if (pixelBytes < imageSize) {
+            std::cerr << "Could not read image data ('" << filename << "')\n";
+            return {};
+        }
+        image.pixels = pixels;
     }
 
-    image.data.resize(imageSize);  // Allocate memory for image data
+    // The TGA file stores pixels in BGR(A) byte order. OpenGL accepts that order directly
+    // as GL_BGR(A), so no conversion is needed. Use util::swapRedBlue() if RGB(A) is required.
 
-    // Attempt to read image data
-    // std::ifstream::read() only reads 'char', thus we need a type cast for tga.header
-    in.read(reinterpret_cast<char*>(image.data.data()), imageSize);
-    if (in.gcount() != imageSize) {
-        std::cerr << "Could not read image data ('" << filename << "')\n";
-        return {};
+    return image;
+}
+
+/* Expand image data in any of the TGA layouts to 4 bytes per pixel in RGBA order */
+static std::vector<GLubyte> expandToRGBA(const GLubyte* data, size_t numPixels, GLuint format) {
+    const size_t channels = (format == GL_RED)   ? 1
+                            : (format == GL_RG)  ? 2
+                            : (format == GL_BGR) ? 3
+                                                 : 4;
+    std::vector<GLubyte> rgba(4 * numPixels);
+    for (size_t i = 0; i < numPixels; i++) {
+        const GLubyte* src = &data[channels * i];
+        GLubyte* dst = &rgba[4 * i];
+        switch (format) {
+            case GL_RED:  // Gray: R = G = B = gray, opaque
+                dst[0] = dst[1] = dst[2] = src[0];
+                dst[3] = 255;
+                break;
+            case GL_RG:  // Gray and alpha: keep them in R and G for BC5
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[0];
+                dst[3] = src[1];
+                break;
+            default:
+                dst[0] = src[2];
+                dst[1] = src[1];
+                dst[2] = src[0];
+                dst[3] = (channels == 4) ? src[3] : 255;
+                break;
+        }
+    }
+    return rgba;
+}
+
+/* GL internal format for a block compression, or 0 if the GL context does not support it */
+static GLenum compressedInternalFormat(Texture::Compression compression, bool srgb) {
+    const bool s3tc = GLEW_EXT_texture_compression_s3tc;
+    const bool rgtc = GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc ||
+                      GLEW_EXT_texture_compression_rgtc;
+    srgb = srgb && GLEW_EXT_texture_sRGB;
+    switch (compression) {
+        case Texture::Compression::BC1:
+            return !s3tc ? 0
+                   : srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+                          : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case Texture::Compression::BC3:
+            return !s3tc ? 0
+                   : srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+                          : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case Texture::Compression::BC4:
+            return rgtc ? GL_COMPRESSED_RED_RGTC1 : 0;
+        case Texture::Compression::BC5:
+            return rgtc ? GL_COMPRESSED_RG_RGTC2 : 0;
+        default:
+            return 0;
     }
+}
 
-    // Swap the BGR(A) byte order in the TGA file to the standard RGB(A) byte order for OpenGL.
-    for (size_t cswap = 0; cswap < imageSize; cswap += bytesPerPixel) {
-        std::swap(image.data[cswap], image.data[cswap + 2]);
+/*
+ * Decode a TGA file and build all mipmap levels on the CPU, block compressed if
+ * compression is not None. The levels are stored in a KTX file in the cache directory,
+ * keyed by a hash of the TGA file and the options that change the result, so that
+ * later loads of the same file only read the cache file.
+ */
+bool Texture::loadMipmaps(const std::string& filename, bool srgb, Compression compression,
+                          KTXImage& ktx) {
+    GLenum compressedFormat = 0;
+    if (compression != Compression::None) {
+        compressedFormat = compressedInternalFormat(compression, srgb);
+        if (compressedFormat == 0) {
+            std::cerr << "Texture compression not supported, loading uncompressed ('"
+                      << filename << "')\n";
+            compression = Compression::None;
+        }
     }
 
-    return image;
+    // The TGA file is mapped once, to hash it and, if it is not cached, to decode it
+    MappedFile source;
+    if (!source.open(filename)) {
+        std::cerr << "Could not open texture file ('" << filename << "')\n";
+        return false;
+    }
+
+    std::string cacheFile;
+    if (!cacheDirectory_.empty()) {
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx",
+                 static_cast<unsigned long long>(util::hashBytes(source.data(), source.size())));
+        const char* suffix = (compression == Compression::BC1)   ? "-bc1"
+                             : (compression == Compression::BC3) ? "-bc3"
+                             : (compression == Compression::BC4) ? "-bc4"
+                             : (compression == Compression::BC5) ? "-bc5"
+                                                                 : "";
+        cacheFile = cacheDirectory_ + "/" + hash + suffix + (srgb ? "-srgb" : "") +
+                    (mipmapFilter_ == mipmap::Filter::Kaiser ? "-kaiser" : "") + ".ktx";
+        if (ktx::read(cacheFile, ktx)) {
+            return true;
+        }
+    }
+
+    // Not cached: decode the TGA file and build the mipmaps
+    const ImageData image = loadTGA(filename, source);
+    if (image.pixels == nullptr) {
+        return false;
+    }
+    const int channels = (image.format == GL_RED)   ? 1
+                         : (image.format == GL_RG)  ? 2
+                         : (image.format == GL_BGR) ? 3
+                                                    : 4;
+    const size_t numPixels = static_cast<size_t>(image.width) * image.height;
+    const std::vector<mipmap::Level> levels =
+        mipmap::build(image.pixels, image.width, image.height, channels, srgb, mipmapFilter_);
+
+    ktx = KTXImage();
+    ktx.width = image.width;
+    ktx.height = image.height;
+    if (image.type == GL_RED || image.type == GL_RG) {
+        // Present single channel images as gray, and two channel images as gray with alpha
+        ktx.swizzle = (image.type == GL_RG) ? "rrrg" : "rrr1";
+    }
+    if (compression == Compression::None) {
+        ktx.glType = GL_UNSIGNED_BYTE;
+        ktx.glFormat = image.format;
+        ktx.glInternalFormat = sizedInternalFormat(image.type, srgb);
+        ktx.glBaseInternalFormat = image.type;
+        // The base level is padded straight from the pixels of the TGA file
+        ktx.levels.push_back(ktx::padRows(image.pixels, image.width, image.height, channels));
+        for (const mipmap::Level& level : levels) {
+            ktx.levels.push_back(
+                ktx::padRows(level.data.data(), level.width, level.height, channels));
+        }
+    } else {
+        const bc::Format format = (compression == Compression::BC1)   ? bc::Format::BC1
+                                  : (compression == Compression::BC3) ? bc::Format::BC3
+                                  : (compression == Compression::BC4) ? bc::Format::BC4
+                                                                      : bc::Format::BC5;
+        ktx.glInternalFormat = compressedFormat;
+        ktx.glBaseInternalFormat = (compression == Compression::BC1)   ? GL_RGB
+                                   : (compression == Compression::BC3) ? GL_RGBA
+                                   : (compression == Compression::BC4) ? GL_RED
+                                                                       : GL_RG;
+        // A BC5 texture made from a color image holds red and green, not gray and alpha
+        if (compression == Compression::BC5 && image.type != GL_RG) {
+            ktx.swizzle.clear();
+        }
+        const std::vector<GLubyte> base = expandToRGBA(image.pixels, numPixels, image.format);
+        ktx.levels.push_back(bc::compress(base.data(), image.width, image.height, format));
+        for (const mipmap::Level& level : levels) {
+            const std::vector<GLubyte> rgba =
+                expandToRGBA(level.data.data(), level.data.size() / channels, image.format);
+            ktx.levels.push_back(bc::compress(rgba.data(), level.width, level.height, format));
+        }
+    }
+
+    if (!cacheFile.empty()) {
+        // Write to a temporary file first, so that a texture loaded by several threads
+        // at once never sees a partly written cache file
+        std::error_code ec;
+        std::filesystem::create_directories(cacheDirectory_, ec);
+        const size_t threadHash = std::hash<std::thread::id>()(std::this_thread::get_id());
+        const std::string tempFile = cacheFile + "." + std::to_string(threadHash);
+        if (ktx::write(tempFile, ktx)) {
+            std::filesystem::rename(tempFile, cacheFile, ec);
+        }
+    }
+    return true;
 }
 
 /*
- * Load and activate a 2D texture from a TGA file
+ * Build the mipmaps of an uncompressed KTX image which has only its base level, so that
+ * levels can be dropped to fit the memory budget. Compressed images are left as they are.
+ * Returns false if the base level is too short for its size.
  */
-void Texture::createTexture(const std::string& filename) {
-    image_ = loadUncompressedTGA(filename);
+static bool buildMissingMipmaps(KTXImage& ktx) {
+    const int channels = (ktx.glFormat == GL_RED)                            ? 1
+                         : (ktx.glFormat == GL_RG)                           ? 2
+                         : (ktx.glFormat == GL_RGB || ktx.glFormat == GL_BGR) ? 3
+                         : (ktx.glFormat == GL_RGBA || ktx.glFormat == GL_BGRA) ? 4
+                                                                              : 0;
+    if (ktx.numLevels() != 1 || ktx.glType != GL_UNSIGNED_BYTE || channels == 0 ||
+        (ktx.width == 1 && ktx.height == 1)) {
+        return true;
+    }
+    // Remove the row padding, build the levels and pad them again
+    const size_t rowSize = static_cast<size_t>(ktx.width) * channels;
+    const size_t pitch = ktx::rowPitch(ktx.width, channels);
+    if (ktx.height == 0 || ktx.levelSize(0) / ktx.height < pitch) {
+        return false;
+    }
+    std::vector<GLubyte> pixels(rowSize * ktx.height);
+    for (GLuint y = 0; y < ktx.height; y++) {
+        std::memcpy(&pixels[y * rowSize], ktx.levelData(0) + y * pitch, rowSize);
+    }
+    std::vector<std::vector<GLubyte>> levels;
+    levels.emplace_back(ktx.levelData(0), ktx.levelData(0) + ktx.levelSize(0));
+    const bool srgb = (ktx.glInternalFormat == GL_SRGB8 || ktx.glInternalFormat == GL_SRGB8_ALPHA8);
+    for (const mipmap::Level& level :
+         mipmap::build(pixels.data(), ktx.width, ktx.height, channels, srgb)) {
+        levels.push_back(ktx::padRows(level.data.data(), level.width, level.height, channels));
+    }
+    ktx.releaseData();
+    ktx.levels = std::move(levels);
+    return true;
+}
 
-    if (image_.data.empty()) {
-        return;
+/* Load all mipmap levels from a KTX file, or from a TGA file through loadMipmaps() */
+bool Texture::loadImage(const std::string& filename, bool srgb, Compression compression,
+                        KTXImage& ktx) {
+    if (std::filesystem::path(filename).extension() != ".ktx") {
+        return loadMipmaps(filename, srgb, compression, ktx);
+    }
+    if (!ktx::read(filename, ktx) || !buildMissingMipmaps(ktx)) {
+        std::cerr << "Could not load texture file ('" << filename << "')\n";
+        ktx.releaseData();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Create a new texture object and upload the levels of a KTX image to it, starting at
+ * firstLevel, or further down if fitBudget is set and the levels would not fit in the
+ * memory budget.
+ * The data of each level is taken from levels, which points either to memory or, as
+ * offsets, into the bound GL_PIXEL_UNPACK_BUFFER. ktx.levels is not used.
+ * Immutable storage cannot be reallocated, so a previous texture object is deleted.
+ * A file without mipmaps gets them generated by glGenerateMipmap().
+ */
+void Texture::uploadTexture(const KTXImage& ktx, const std::vector<LevelData>& allLevels,
+                            GLsizei firstLevel, bool fitBudget) {
+    const bool compressed = (ktx.glType == 0);
+    const GLsizei fullChain =
+        1 + static_cast<GLsizei>(std::floor(std::log2(std::max(ktx.width, ktx.height))));
+    const bool generate = (allLevels.size() == 1 && fullChain > 1 && !compressed);
+
+    // Bytes of the GPU storage for each level
+    const GLsizei numLevels = generate ? fullChain : static_cast<GLsizei>(allLevels.size());
+    std::vector<size_t> levelBytes(numLevels);
+    for (GLsizei level = 0; level < numLevels; level++) {
+        levelBytes[level] = compressed ? allLevels[level].size
+                                       : static_cast<size_t>(std::max(ktx.width >> level, 1u)) *
+                                             std::max(ktx.height >> level, 1u) *
+                                             bytesPerTexel(ktx.glInternalFormat);
+    }
+
+    // Drop the largest levels until the texture fits the budget, but keep the smallest level.
+    // The levels this texture holds now are released first.
+    allocatedMemory_ -= memoryUsage_;
+    // Only the base level is available when the mipmaps are generated on the GPU.
+    GLsizei first = generate ? 0 : std::clamp<GLsizei>(firstLevel, 0, numLevels - 1);
+    size_t bytes = 0;
+    for (GLsizei level = first; level < numLevels; level++) {
+        bytes += levelBytes[level];
+    }
+    while (fitBudget && memoryBudget_ != 0 && !generate && first + 1 < numLevels &&
+           allocatedMemory_ + bytes > memoryBudget_) {
+        bytes -= levelBytes[first];
+        first++;
+    }
+    if (first > firstLevel) {
+        std::cout << "Texture memory budget exceeded, dropping " << first
+                  << " mipmap levels ('" << filename_ << "')\n";
     }
+    droppedLevels_ = first;
+    const std::vector<LevelData> levels(allLevels.begin() + first, allLevels.end());
+    const GLuint width = std::max(ktx.width >> first, 1u);
+    const GLuint height = std::max(ktx.height >> first, 1u);
 
-    if (textureID_ == 0) {
-        glGenTextures(1, &textureID_);  // Create the texture ID if it does not exist
+    image_.width = width;
+    image_.height = height;
+    image_.type = ktx.glBaseInternalFormat;
+    image_.format = ktx.glFormat;
+    image_.data = std::vector<GLubyte>();
+    internalFormat_ = ktx.glInternalFormat;
+    levels_ = numLevels - first;
+    memoryUsage_ = 0;
+
+    if (textureID_ != 0) {
+        glstate::deleteTextures(1, &textureID_);
     }
+    glGenTextures(1, &textureID_);
 
-    glBindTexture(GL_TEXTURE_2D, textureID_);
+    glstate::bindTexture(GL_TEXTURE_2D, textureID_);
     // Set parameters to determine how the texture is resized
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    (levels_ > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // Set parameters to determine how the texture wraps at edges
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Read the texture data from file and upload it to the GPU
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_.width, image_.height, 0, image_.type,
-                 GL_UNSIGNED_BYTE, image_.data.data());
+    if (ktx.swizzle.size() == 4) {
+        GLint swizzle[4];
+        for (int i = 0; i < 4; i++) {
+            switch (ktx.swizzle[i]) {
+                case 'r':
+                    swizzle[i] = GL_RED;
+                    break;
+                case 'g':
+                    swizzle[i] = GL_GREEN;
+                    break;
+                case 'b':
+                    swizzle[i] = GL_BLUE;
+                    break;
+                case 'a':
+                    swizzle[i] = GL_ALPHA;
+                    break;
+                case '0':
+                    swizzle[i] = GL_ZERO;
+                    break;
+                default:
+                    swizzle[i] = GL_ONE;
+                    break;
+            }
+        }
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
 
-    glEnable(GL_TEXTURE_2D);  // Required for glGenerateMipmap() to work
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // Allocate all mipmap levels. With GL 4.2 or ARB_texture_storage the storage is
+    // immutable, which lets the driver skip consistency checks when it is used.
+    const bool immutable = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    if (immutable) {
+        glTexStorage2D(GL_TEXTURE_2D, levels_, internalFormat_, width, height);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels_ - 1);
+    }
 
-    // Image data was copied to the GPU, release contents of the std::vector
-    // When using clear() the std::vector would still hold on to the memory.
-    image_.data = std::vector<GLubyte>();
+    // Rows of uncompressed KTX levels are padded to 4 bytes, the default GL_UNPACK_ALIGNMENT
+    for (GLsizei level = 0; level < levels_; level++) {
+        const GLsizei w = static_cast<GLsizei>(std::max(width >> level, 1u));
+        const GLsizei h = static_cast<GLsizei>(std::max(height >> level, 1u));
+        const bool hasData = (level < static_cast<GLsizei>(levels.size()));
+        const void* data = hasData ? levels[level].pixels : nullptr;
+        if (compressed) {
+            const GLsizei size = static_cast<GLsizei>(levels[level].size);
+            if (immutable) {
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, internalFormat_,
+                                          size, data);
+            } else {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat_, w, h, 0, size,
+                                       data);
+            }
+            memoryUsage_ += size;
+        } else {
+            if (immutable) {
+                if (hasData) {
+                    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, ktx.glFormat, ktx.glType,
+                                    data);
+                }
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, level, internalFormat_, w, h, 0, ktx.glFormat,
+                             ktx.glType, data);
+            }
+            memoryUsage_ += static_cast<size_t>(w) * h * bytesPerTexel(internalFormat_);
+        }
+    }
+
+    if (generate) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    allocatedMemory_ += memoryUsage_;
+}
+
+/*
+ * Load and activate a 2D texture from a TGA or KTX file
+ *
+ * KTX files are uploaded as they are. For TGA files, the mipmaps are built on the CPU
+ * and cached as KTX files (see loadMipmaps()), so all levels are uploaded from memory.
+ */
+void Texture::createTexture(const std::string& filename, bool srgb, Compression compression) {
+    if (filename.empty()) {
+        return;
+    }
+
+    filename_ = filename;
+    srgb_ = srgb;
+    compression_ = compression;
+    reload(0, true);
 }
+
+/* Load the texture again from its file, with the levels above firstLevel dropped */
+bool Texture::reload(GLsizei firstLevel, bool fitBudget) {
+    KTXImage ktx;
+    if (filename_.empty() || !loadImage(filename_, srgb_, compression_, ktx)) {
+        return false;
+    }
+    // Levels read from a KTX file are uploaded straight from the mapped file
+    std::vector<LevelData> levels;
+    for (size_t level = 0; level < ktx.numLevels(); level++) {
+        levels.push_back({ktx.levelData(level), ktx.levelSize(level)});
+    }
+    uploadTexture(ktx, levels, firstLevel, fitBudget);
+    return true;
+}
+
+void Texture::bind(GLuint unit) {
+    glstate::activeTexture(GL_TEXTURE0 + unit);
+    glstate::bindTexture(GL_TEXTURE_2D, textureID_);
+    usage_++;
+}
+
+GLsizei Texture::droppedLevels() const { return droppedLevels_; }
+
+void Texture::setMemoryBudget(size_t bytes) { memoryBudget_ = bytes; }
+
+size_t Texture::memoryBudget() { return memoryBudget_; }
+
+size_t Texture::allocatedMemory() { return allocatedMemory_; }
+
+/*
+ * Move memory from textures which are rarely bound to textures which are often bound.
+ * Textures with dropped levels get one level back, most used first, if it fits in the
+ * budget after dropping a level of unused textures. If the budget is exceeded, for
+ * example after it was lowered, the least used textures drop one level at a time
+ * until it fits.
+ */
+void Texture::balanceMemory() {
+    std::vector<Texture*> textures;
+    for (Texture* texture : textures_) {
+        if (texture->textureID_ != 0 && !texture->filename_.empty()) {
+            textures.push_back(texture);
+        }
+    }
+    // Least used first
+    std::sort(textures.begin(), textures.end(),
+              [](const Texture* a, const Texture* b) { return a->usage_ < b->usage_; });
+    const size_t budget = (memoryBudget_ != 0) ? memoryBudget_ : SIZE_MAX;
+
+    // Dropping a level frees about three quarters of the memory of a texture
+    size_t reclaimable = 0;
+    for (const Texture* texture : textures) {
+        if (texture->usage_ == 0 && texture->levels_ > 1) {
+            reclaimable += texture->memoryUsage_ - texture->memoryUsage_ / 4;
+        }
+    }
+    size_t victim = 0;  // Next unused texture to demote
+    for (auto it = textures.rbegin(); it != textures.rend(); ++it) {
+        Texture* texture = *it;
+        if (texture->usage_ == 0 || texture->droppedLevels_ == 0) {
+            continue;
+        }
+        // One level up is about four times the memory
+        const size_t needed = 3 * texture->memoryUsage_;
+        if (allocatedMemory_ + needed > budget &&
+            allocatedMemory_ + needed - std::min(reclaimable, allocatedMemory_ + needed) >
+                budget) {
+            continue;
+        }
+        while (allocatedMemory_ + needed > budget && victim < textures.size() &&
+               textures[victim]->usage_ == 0) {
+            Texture* unused = textures[victim++];
+            if (unused->levels_ > 1) {
+                reclaimable -= unused->memoryUsage_ - unused->memoryUsage_ / 4;
+                unused->reload(unused->droppedLevels_ + 1, false);
+            }
+        }
+        if (allocatedMemory_ + needed <= budget) {
+            texture->reload(texture->droppedLevels_ - 1, false);
+        }
+    }
+
+    // Over budget: drop one level of each texture in turn, least used first
+    bool dropped = true;
+    while (allocatedMemory_ > budget && dropped) {
+        dropped = false;
+        for (Texture* texture : textures) {
+            if (allocatedMemory_ <= budget) {
+                break;
+            }
+            if (texture->levels_ > 1 && texture->reload(texture->droppedLevels_ + 1, false)) {
+                dropped = true;
+            }
+        }
+    }
+
+    for (Texture* texture : textures) {
+        texture->usage_ = 0;
+    }
+}
+
+/*
+ * Create a 1x1 mid-gray texture to stand in for an image which is still loading.
+ * It is replaced by uploadTexture().
+ */
+void Texture::createPlaceholder() {
+    if (textureID_ != 0) {
+        glstate::deleteTextures(1, &textureID_);
+    }
+    glGenTextures(1, &textureID_);
+    glstate::bindTexture(GL_TEXTURE_2D, textureID_);
+    const GLubyte gray[4] = {128, 128, 128, 255};
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gray);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    image_ = ImageData{1, 1, GL_RGBA, GL_RGBA, {}};
+    internalFormat_ = GL_RGBA8;
+    levels_ = 1;
+    allocatedMemory_ += 4 - memoryUsage_;
+    memoryUsage_ = 4;
+}
+
+bool Texture::loadRGBA(const std::string& filename, GLuint& width, GLuint& height,
+                       std::vector<GLubyte>& rgba) {
+    MappedFile file;
+    file.open(filename);
+    const ImageData image = loadTGA(filename, file);
+    if (image.pixels == nullptr) {
+        return false;
+    }
+    width = image.width;
+    height = image.height;
+    rgba = expandToRGBA(image.pixels, static_cast<size_t>(width) * height, image.format);
+    if (image.format == GL_RG) {
+        // expandToRGBA() keeps gray and alpha in R and G, make G gray too
+        for (size_t i = 0; i < rgba.size(); i += 4) {
+            rgba[i + 1] = rgba[i];
+        }
+    }
+    return true;
+}
+
+void Texture::setCacheDirectory(const std::string& directory) { cacheDirectory_ = directory; }
+
+void Texture::setMipmapFilter(mipmap::Filter filter) { mipmapFilter_ = filter; }
@@ -4,8 +4,21 @@
  * Modified, stripped-down and cleaned-up version of the TGA loader from NeHe tutorial 33.
  *
  * Usage: Call createTexture() with a TGA file as argument to load a texture,
- *        or use the constructor with a file name argument. Uncompressed RGB or RGBA only.
- *        Call glBindTexture() with the public member textureID as argument.
+ *        or use the constructor with a file name argument. RGB, RGBA, grayscale or
+ *        grayscale with alpha, either uncompressed or RLE compressed.
+ *        The mipmaps of TGA files are built on the CPU (see MipmapBuilder.hpp) and
+ *        cached as KTX files in the directory set by setCacheDirectory(), so later
+ *        loads of the same file skip decoding and filtering. KTX files are loaded directly.
+ *        Pass srgb = true for color images stored in sRGB, to have them decoded to
+ *        linear values when sampled.
+ *        Pass a Compression other than None to store the texture block compressed on the
+ *        GPU. The compressed levels are cached the same way.
+ *        With setMemoryBudget(), textures which would exceed the budget are loaded without
+ *        their largest mipmap levels. Bind textures with bind(), which counts how often
+ *        they are used, and call balanceMemory() now and then (say once a second) to give
+ *        levels back to often used textures and take them from unused ones.
+ *        bind() goes through the state cache in GLState.hpp, so a texture which is
+ *        already bound to the unit is not bound again.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2014
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -16,40 +29,131 @@
 
 #include <GLFW/glfw3.h>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
+#include "MappedFile.hpp"
+#include "MipmapBuilder.hpp"
+
+struct KTXImage;
+
 class Texture {
 public:
+    // Block compression formats, see TextureCompression.hpp.
+    // BC1: RGB, BC3: RGBA, BC4: one channel (gray), BC5: two channels (gray and alpha, or RG)
+    enum class Compression { None, BC1, BC3, BC4, BC5 };
 
     /* Constructor to load and intialize the texture all at once */
-    Texture(const std::string& filename = "");
+    Texture(const std::string& filename = "", bool srgb = false,
+            Compression compression = Compression::None);
 
     /* Destructor */
     ~Texture();
 
-    // The external entry point for loading a texture from a TGA file
-    void createTexture(const std::string& filename);  // Load GL texture from file
+    /* A Texture owns its texture object. It can be moved but not copied. */
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+    Texture(Texture&& other) noexcept;
+    Texture& operator=(Texture&& other) noexcept;
+
+    // The external entry point for loading a texture from a TGA or KTX file
+    void createTexture(const std::string& filename, bool srgb = false,
+                       Compression compression = Compression::None);  // Load GL texture from file
 
     // returns the OpenGL texture ID
     GLuint id() const;
 
+    // Bind the texture to a texture unit, and count the use for balanceMemory()
+    void bind(GLuint unit = 0);
+
     GLuint width() const;
     GLuint height() const;
 
-    // returns the type of the texture (GL_RGB or GL_RGBA)
+    // returns the type of the texture (GL_RED, GL_RG, GL_RGB or GL_RGBA)
     GLuint type() const;
 
+    // returns the sized internal format of the texture (GL_RGB8, GL_SRGB8_ALPHA8, ...)
+    GLenum internalFormat() const;
+
+    // returns the number of mipmap levels
+    GLsizei levels() const;
+
+    // returns the GPU memory allocated for all mipmap levels, in bytes
+    size_t memoryUsage() const;
+
+    // returns the number of largest mipmap levels left out to fit the memory budget
+    GLsizei droppedLevels() const;
+
+    // Set the GPU memory budget for all textures in bytes, 0 for no limit (the default)
+    static void setMemoryBudget(size_t bytes);
+    static size_t memoryBudget();
+
+    // returns the GPU memory allocated by all textures, in bytes
+    static size_t allocatedMemory();
+
+    // Reload textures with more or fewer mipmap levels, depending on their use
+    static void balanceMemory();
+
+    // Load a TGA file with 4 bytes per pixel in RGBA order, for code that combines images.
+    // Gray images are expanded to gray RGB. Returns false if the file could not be loaded.
+    static bool loadRGBA(const std::string& filename, GLuint& width, GLuint& height,
+                         std::vector<GLubyte>& rgba);
+
+    // Set the directory for cached mipmaps (default "texturecache"). Empty disables the cache.
+    static void setCacheDirectory(const std::string& directory);
+
+    // Set the filter used to build mipmaps for TGA files (default Box)
+    static void setMipmapFilter(mipmap::Filter filter);
+
 private:
     struct ImageData {
         GLuint width = 0;                // Image width
         GLuint height = 0;               // Image height
-        GLuint type = 0;                 // Image type (3 bytes per pixel: GL_RGB, 4 bytes: GL_RGBA)
-        std::vector<GLubyte> data;  // Image data (3 or 4 bytes per pixel)
+        GLuint type = 0;                 // Image type (GL_RED, GL_RG, GL_RGB or GL_RGBA)
+        GLuint format = 0;               // Byte order of data (GL_BGR or GL_BGRA for TGA files)
+        std::vector<GLubyte> data;  // Decoded image data, for RLE compressed files
+        const GLubyte* pixels = nullptr;  // Image data (1 to 4 bytes per pixel), in data
+                                          // or in the mapped file
+    };
+
+    // Pixels of one mipmap level, in memory or as an offset into a pixel unpack buffer
+    struct LevelData {
+        const void* pixels;
+        size_t size;
     };
 
-    // Load data from an uncompressed TGA file
-    ImageData loadUncompressedTGA(const std::string& filename) const;
+    // Load data from an uncompressed or RLE compressed TGA file mapped into memory
+    static ImageData loadTGA(const std::string& filename, const MappedFile& file);
+
+    // Load all mipmap levels for a TGA file from the cache, or build them
+    static bool loadMipmaps(const std::string& filename, bool srgb, Compression compression,
+                            KTXImage& ktx);
+    // Load all mipmap levels from a KTX or TGA file. Does not use OpenGL, so it can
+    // be called from any thread.
+    static bool loadImage(const std::string& filename, bool srgb, Compression compression,
+                          KTXImage& ktx);
+
+    void uploadTexture(const KTXImage& ktx, const std::vector<LevelData>& allLevels,
+                       GLsizei firstLevel = 0, bool fitBudget = true);
+    void createPlaceholder();
+    bool reload(GLsizei firstLevel, bool fitBudget);
+
+    friend class TextureStreamer;
+
+    static std::string cacheDirectory_;
+    static mipmap::Filter mipmapFilter_;
+    static size_t memoryBudget_;
+    static size_t allocatedMemory_;
+    static std::unordered_set<Texture*> textures_;  // All textures, for balanceMemory()
 
-    GLuint textureID_;  // Texture ID for OpenGL
+    GLuint textureID_;        // Texture ID for OpenGL
+    GLenum internalFormat_;   // Sized internal format of the texture storage
+    GLsizei levels_;          // Number of mipmap levels
+    size_t memoryUsage_;      // Bytes allocated for all mipmap levels
+    GLsizei droppedLevels_;   // Largest levels left out to fit the memory budget
+    unsigned usage_;          // Calls to bind() since the last balanceMemory()
+    std::string filename_;    // File and options the texture was loaded with, for reload()
+    bool srgb_;
+    Compression compression_;
     ImageData image_;
 };
@@ -0,0 +1,319 @@
+/*
+ * CPU encoder for block compressed texture formats
+ *
+ * BC1 colors are fitted along the principal axis of the block colors, followed by
+ * one least-squares refinement of the endpoints. BC4 channels use the minimum and
+ * maximum value as endpoints with the 8-value interpolation mode.
+ *
+ * This code is in the public domain.
+ */
+#include "TextureCompression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+namespace bc {
+
+size_t blockSize(Format format) {
+    return (format == Format::BC1 || format == Format::BC4) ? 8 : 16;
+}
+
+size_t compressedSize(Format format, GLuint width, GLuint height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+}
+
+/* Pack an RGB color to 5:6:5 bits with rounding */
+static uint16_t packRGB565(const float* c) {
+    const auto quantize = [](float v, float levels) {
+        return static_cast<uint16_t>(std::lround(std::clamp(v, 0.0f, 255.0f) * levels / 255.0f));
+    };
+    return static_cast<uint16_t>((quantize(c[0], 31.0f) << 11) | (quantize(c[1], 63.0f) << 5) |
+                                 quantize(c[2], 31.0f));
+}
+
+/* Expand a 5:6:5 color to 8 bits per channel, the way the hardware decodes it */
+static void unpackRGB565(uint16_t c, float* out) {
+    const int r = (c >> 11) & 31;
+    const int g = (c >> 5) & 63;
+    const int b = c & 31;
+    out[0] = static_cast<float>((r << 3) | (r >> 2));
+    out[1] = static_cast<float>((g << 2) | (g >> 4));
+    out[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+/*
+ * Choose the nearest of the 4 palette colors for each pixel. Returns the squared error,
+ * and writes the indices (2 bits per pixel, first pixel in the lowest bits).
+ */
+static float colorIndices(const GLubyte* rgba, uint16_t c0, uint16_t c1, uint32_t& indices) {
+    float palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int k = 0; k < 3; k++) {
+        palette[2][k] = (2.0f * palette[0][k] + palette[1][k]) / 3.0f;
+        palette[3][k] = (palette[0][k] + 2.0f * palette[1][k]) / 3.0f;
+    }
+
+    float error = 0.0f;
+    indices = 0;
+    for (int i = 0; i < 16; i++) {
+        float best = 1e30f;
+        uint32_t bestIndex = 0;
+        for (uint32_t p = 0; p < 4; p++) {
+            float d = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                const float diff = rgba[4 * i + k] - palette[p][k];
+                d += diff * diff;
+            }
+            if (d < best) {
+                best = d;
+                bestIndex = p;
+            }
+        }
+        indices |= bestIndex << (2 * i);
+        error += best;
+    }
+    return error;
+}
+
+/* Write a color block, ordering the endpoints for the 4-color mode (c0 > c1) */
+static void writeColorBlock(uint16_t c0, uint16_t c1, uint32_t indices, GLubyte* out) {
+    if (c0 < c1) {
+        std::swap(c0, c1);
+        indices ^= 0x55555555;  // Swaps indices 0 <-> 1 and 2 <-> 3
+    } else if (c0 == c1) {
+        indices = 0;
+    }
+    out[0] = static_cast<GLubyte>(c0 & 0xff);
+    out[1] = static_cast<GLubyte>(c0 >> 8);
+    out[2] = static_cast<GLubyte>(c1 & 0xff);
+    out[3] = static_cast<GLubyte>(c1 >> 8);
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = static_cast<GLubyte>(indices >> (8 * i));
+    }
+}
+
+void encodeBC1Block(const GLubyte* rgba, GLubyte* out) {
+    // Mean and covariance of the block colors
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++) {
+        for (int k = 0; k < 3; k++) {
+            mean[k] += rgba[4 * i + k];
+        }
+    }
+    for (float& m : mean) {
+        m /= 16.0f;
+    }
+    float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};  // xx xy xz yy yz zz
+    for (int i = 0; i < 16; i++) {
+        const float r = rgba[4 * i] - mean[0];
+        const float g = rgba[4 * i + 1] - mean[1];
+        const float b = rgba[4 * i + 2] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+
+    // Principal axis by power iteration
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for (int iter = 0; iter < 8; iter++) {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        const float len = std::max({std::fabs(x), std::fabs(y), std::fabs(z)});
+        if (len < 1e-6f) {
+            break;
+        }
+        axis[0] = x / len;
+        axis[1] = y / len;
+        axis[2] = z / len;
+    }
+    const float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+    // Endpoints at the extreme projections, inset by 1/16 of the range against outliers
+    float tmin = 0.0f;
+    float tmax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            t += (rgba[4 * i + k] - mean[k]) * axis[k];
+        }
+        t /= len2;
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+    const float inset = (tmax - tmin) / 16.0f;
+    tmin += inset;
+    tmax -= inset;
+    float e0[3];
+    float e1[3];
+    for (int k = 0; k < 3; k++) {
+        e0[k] = mean[k] + axis[k] * tmax;
+        e1[k] = mean[k] + axis[k] * tmin;
+    }
+
+    uint16_t c0 = packRGB565(e0);
+    uint16_t c1 = packRGB565(e1);
+    uint32_t indices;
+    float error = colorIndices(rgba, c0, c1, indices);
+
+    // Refine the endpoints by least squares, given the chosen palette entries
+    const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};  // Weight of c0
+    float aa = 0.0f;
+    float bb = 0.0f;
+    float ab = 0.0f;
+    float ax[3] = {0.0f, 0.0f, 0.0f};
+    float bx[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++) {
+        const float a = weights[(indices >> (2 * i)) & 3];
+        const float b = 1.0f - a;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int k = 0; k < 3; k++) {
+            ax[k] += a * rgba[4 * i + k];
+            bx[k] += b * rgba[4 * i + k];
+        }
+    }
+    const float det = aa * bb - ab * ab;
+    if (std::fabs(det) > 1e-6f) {
+        for (int k = 0; k < 3; k++) {
+            e0[k] = (ax[k] * bb - bx[k] * ab) / det;
+            e1[k] = (bx[k] * aa - ax[k] * ab) / det;
+        }
+        const uint16_t r0 = packRGB565(e0);
+        const uint16_t r1 = packRGB565(e1);
+        uint32_t refined;
+        const float refinedError = colorIndices(rgba, r0, r1, refined);
+        if (refinedError < error) {
+            c0 = r0;
+            c1 = r1;
+            indices = refined;
+        }
+    }
+
+    writeColorBlock(c0, c1, indices, out);
+}
+
+/* Encode one channel of a block (BC4 layout). channel is the byte offset in each pixel. */
+static void encodeChannelBlock(const GLubyte* rgba, int channel, GLubyte* out) {
+    int lo = 255;
+    int hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = std::min<int>(lo, rgba[4 * i + channel]);
+        hi = std::max<int>(hi, rgba[4 * i + channel]);
+    }
+
+    // 8-value mode: index 0 is hi, 1 is lo, 2-7 interpolate from hi towards lo
+    int palette[8] = {hi, lo};
+    for (int p = 1; p < 7; p++) {
+        palette[p + 1] = ((7 - p) * hi + p * lo + 3) / 7;
+    }
+
+    uint64_t indices = 0;
+    if (hi > lo) {
+        for (int i = 0; i < 16; i++) {
+            const int v = rgba[4 * i + channel];
+            int best = 256;
+            uint64_t bestIndex = 0;
+            for (uint64_t p = 0; p < 8; p++) {
+                const int d = std::abs(v - palette[p]);
+                if (d < best) {
+                    best = d;
+                    bestIndex = p;
+                }
+            }
+            indices |= bestIndex << (3 * i);
+        }
+    }
+
+    out[0] = static_cast<GLubyte>(hi);
+    out[1] = static_cast<GLubyte>(lo);
+    for (int i = 0; i < 6; i++) {
+        out[2 + i] = static_cast<GLubyte>(indices >> (8 * i));
+    }
+}
+
+void encodeBC3Block(const GLubyte* rgba, GLubyte* out) {
+    encodeChannelBlock(rgba, 3, out);  // Alpha
+    encodeBC1Block(rgba, out + 8);     // Color
+}
+
+void encodeBC4Block(const GLubyte* rgba, GLubyte* out) { encodeChannelBlock(rgba, 0, out); }
+
+void encodeBC5Block(const GLubyte* rgba, GLubyte* out) {
+    encodeChannelBlock(rgba, 0, out);
+    encodeChannelBlock(rgba, 1, out + 8);
+}
+
+/* Encode the block rows [rowBegin, rowEnd) of an image */
+static void compressRows(const GLubyte* rgba, GLuint width, GLuint height, Format format,
+                         GLuint rowBegin, GLuint rowEnd, GLubyte* out) {
+    void (*encodeBlock)(const GLubyte*, GLubyte*) = nullptr;
+    switch (format) {
+        case Format::BC1:
+            encodeBlock = encodeBC1Block;
+            break;
+        case Format::BC3:
+            encodeBlock = encodeBC3Block;
+            break;
+        case Format::BC4:
+            encodeBlock = encodeBC4Block;
+            break;
+        case Format::BC5:
+            encodeBlock = encodeBC5Block;
+            break;
+    }
+
+    const GLuint blocksX = (width + 3) / 4;
+    const size_t size = blockSize(format);
+    std::array<GLubyte, 64> block;
+    for (GLuint by = rowBegin; by < rowEnd; by++) {
+        for (GLuint bx = 0; bx < blocksX; bx++) {
+            // Gather the 4x4 block, repeating the last row and column at the edges
+            for (GLuint y = 0; y < 4; y++) {
+                const GLuint sy = std::min(4 * by + y, height - 1);
+                for (GLuint x = 0; x < 4; x++) {
+                    const GLuint sx = std::min(4 * bx + x, width - 1);
+                    const GLubyte* src = rgba + 4 * (static_cast<size_t>(sy) * width + sx);
+                    std::copy_n(src, 4, &block[4 * (4 * y + x)]);
+                }
+            }
+            encodeBlock(block.data(), out + (static_cast<size_t>(by) * blocksX + bx) * size);
+        }
+    }
+}
+
+std::vector<GLubyte> compress(const GLubyte* rgba, GLuint width, GLuint height, Format format,
+                              unsigned numThreads) {
+    std::vector<GLubyte> result(compressedSize(format, width, height));
+    if (width == 0 || height == 0) {
+        return result;
+    }
+
+    const GLuint blocksY = (height + 3) / 4;
+    if (numThreads == 0) {
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    numThreads = std::min(numThreads, blocksY);
+
+    // Split the block rows evenly between the threads, the calling thread takes the first share
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < numThreads; t++) {
+        threads.emplace_back(compressRows, rgba, width, height, format, blocksY * t / numThreads,
+                             blocksY * (t + 1) / numThreads, result.data());
+    }
+    compressRows(rgba, width, height, format, 0, blocksY / numThreads, result.data());
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return result;
+}
+
+}  // namespace bc
@@ -0,0 +1,43 @@
+/*
+ * CPU encoder for the block compressed texture formats BC1, BC3, BC4 and BC5
+ * (also known as DXT1, DXT5, RGTC1 and RGTC2).
+ *
+ * Usage: Call bc::compress() with an image in RGBA byte order (4 bytes per pixel)
+ *        to get the compressed blocks, ready for glCompressedTexImage2D().
+ *        BC1 stores RGB, BC3 stores RGBA, BC4 stores only R and BC5 stores R and G.
+ *        Each 4x4 block of pixels is stored in 8 (BC1, BC4) or 16 (BC3, BC5) bytes.
+ *        The image is split in rows of blocks which are encoded in parallel.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <cstddef>
+#include <vector>
+
+namespace bc {
+
+enum class Format { BC1, BC3, BC4, BC5 };
+
+// Bytes per 4x4 block (8 or 16)
+size_t blockSize(Format format);
+
+// Bytes needed for an image of the given size, including partial blocks at the edges
+size_t compressedSize(Format format, GLuint width, GLuint height);
+
+/*
+ * Compress an image with 4 bytes per pixel in RGBA order. Partial blocks at the right
+ * and bottom edges are padded by repeating the last column and row. numThreads = 0
+ * uses one thread per hardware thread.
+ */
+std::vector<GLubyte> compress(const GLubyte* rgba, GLuint width, GLuint height, Format format,
+                              unsigned numThreads = 0);
+
+// Encode single blocks. rgba holds 16 pixels, 4 bytes each, in row order.
+void encodeBC1Block(const GLubyte* rgba, GLubyte* out);
+void encodeBC3Block(const GLubyte* rgba, GLubyte* out);
+void encodeBC4Block(const GLubyte* rgba, GLubyte* out);
+void encodeBC5Block(const GLubyte* rgba, GLubyte* out);
+
+}  // namespace bc
@@ -0,0 +1,340 @@
+/*
+ * Packing of textures into array textures and atlases
+ *
+ * Atlases are packed with the skyline bottom-left method: the top edge of the packed
+ * area is kept as a list of horizontal segments, and each image is placed where its
+ * bottom ends up lowest. Images are placed in order of decreasing height. All sizes
+ * are multiples of the gutter, so at the mipmap levels an atlas has, image borders
+ * stay on pixel boundaries.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "GLState.hpp"
+#include "MipmapBuilder.hpp"
+#include "TexturePacker.hpp"
+#include "Texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <utility>
+
+static GLuint roundUpToPowerOfTwo(GLuint value) {
+    GLuint result = 1;
+    while (result < value) {
+        result *= 2;
+    }
+    return result;
+}
+
+static GLuint roundUpToMultiple(GLuint value, GLuint multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+TexturePacker::TexturePacker(GLuint gutter, GLuint maxAtlasSize)
+    : gutter_(roundUpToPowerOfTwo(std::max(gutter, 1u))), maxAtlasSize_(maxAtlasSize) {}
+
+TexturePacker::~TexturePacker() {
+    if (!textures_.empty()) {
+        glstate::deleteTextures(static_cast<GLsizei>(textures_.size()), textures_.data());
+    }
+}
+
+int TexturePacker::add(const std::string& filename) {
+    Image image;
+    image.filename = filename;
+    if (!Texture::loadRGBA(filename, image.width, image.height, image.rgba)) {
+        return -1;
+    }
+    images_.push_back(std::move(image));
+    placements_.emplace_back();
+    return static_cast<int>(images_.size()) - 1;
+}
+
+const TexturePacker::Placement& TexturePacker::placement(int index) const {
+    return placements_[index];
+}
+
+size_t TexturePacker::textureCount() const { return textures_.size(); }
+
+void TexturePacker::pack(bool srgb) {
+    // Group the images which are not packed yet by size
+    std::map<std::pair<GLuint, GLuint>, std::vector<int>> bySize;
+    for (size_t i = 0; i < images_.size(); i++) {
+        if (placements_[i].texture == 0 && !images_[i].rgba.empty()) {
+            bySize[{images_[i].width, images_[i].height}].push_back(static_cast<int>(i));
+        }
+    }
+
+    std::vector<int> mixed;
+    for (const auto& group : bySize) {
+        if (group.second.size() > 1) {
+            packArray(group.second, srgb);
+        } else {
+            mixed.push_back(group.second.front());
+        }
+    }
+    if (!mixed.empty()) {
+        packAtlases(mixed, srgb);
+    }
+
+    for (Image& image : images_) {
+        image.rgba = std::vector<GLubyte>();
+    }
+    std::cout << "Packed " << images_.size() << " images into " << textures_.size()
+              << " textures\n";
+}
+
+/* Allocate storage for a texture and upload all levels, from the largest down */
+static void uploadLevels(GLenum target, GLenum internalFormat, GLuint width, GLuint height,
+                         GLsizei layers, const std::vector<std::vector<GLubyte>>& levels) {
+    const GLsizei numLevels = static_cast<GLsizei>(levels.size());
+    const bool immutable = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    if (immutable) {
+        if (target == GL_TEXTURE_2D_ARRAY) {
+            glTexStorage3D(target, numLevels, internalFormat, width, height, layers);
+        } else {
+            glTexStorage2D(target, numLevels, internalFormat, width, height);
+        }
+    }
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+    for (GLsizei level = 0; level < numLevels; level++) {
+        const GLsizei w = static_cast<GLsizei>(std::max(width >> level, 1u));
+        const GLsizei h = static_cast<GLsizei>(std::max(height >> level, 1u));
+        const GLubyte* data = levels[level].data();
+        if (target == GL_TEXTURE_2D_ARRAY) {
+            if (immutable) {
+                glTexSubImage3D(target, level, 0, 0, 0, w, h, layers, GL_RGBA, GL_UNSIGNED_BYTE,
+                                data);
+            } else {
+                glTexImage3D(target, level, internalFormat, w, h, layers, 0, GL_RGBA,
+                             GL_UNSIGNED_BYTE, data);
+            }
+        } else {
+            if (immutable) {
+                glTexSubImage2D(target, level, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            } else {
+                glTexImage2D(target, level, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                             data);
+            }
+        }
+    }
+}
+
+/* Store images of the same size as the layers of an array texture, with all mipmaps */
+void TexturePacker::packArray(const std::vector<int>& indices, bool srgb) {
+    const GLuint width = images_[indices.front()].width;
+    const GLuint height = images_[indices.front()].height;
+    const GLsizei layers = static_cast<GLsizei>(indices.size());
+
+    // Each level holds that level of all layers, one after the other
+    std::vector<std::vector<GLubyte>> levels(1);
+    for (int index : indices) {
+        const std::vector<GLubyte>& rgba = images_[index].rgba;
+        levels[0].insert(levels[0].end(), rgba.begin(), rgba.end());
+        const std::vector<mipmap::Level> mips =
+            mipmap::build(rgba.data(), width, height, 4, srgb);
+        levels.resize(mips.size() + 1);
+        for (size_t level = 0; level < mips.size(); level++) {
+            levels[level + 1].insert(levels[level + 1].end(), mips[level].data.begin(),
+                                     mips[level].data.end());
+        }
+    }
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glstate::bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    uploadLevels(GL_TEXTURE_2D_ARRAY, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, width, height, layers,
+                 levels);
+    textures_.push_back(texture);
+
+    for (GLint layer = 0; layer < layers; layer++) {
+        Placement& placement = placements_[indices[layer]];
+        placement.target = GL_TEXTURE_2D_ARRAY;
+        placement.texture = texture;
+        placement.layer = layer;
+    }
+}
+
+// A horizontal segment of the top edge of the packed area in an atlas
+struct SkylineSegment {
+    GLuint x;
+    GLuint y;
+    GLuint width;
+};
+
+/*
+ * Find the lowest position for a rectangle of size w x h on the skyline, in an atlas
+ * of size size x size. Returns false if it does not fit.
+ */
+static bool findPosition(const std::vector<SkylineSegment>& skyline, GLuint size, GLuint w,
+                         GLuint h, size_t& bestSegment, GLuint& bestY) {
+    bool found = false;
+    for (size_t i = 0; i < skyline.size(); i++) {
+        const GLuint x = skyline[i].x;
+        if (x + w > size) {
+            break;
+        }
+        // The rectangle rests on the highest segment under it
+        GLuint y = 0;
+        for (size_t j = i; j < skyline.size() && skyline[j].x < x + w; j++) {
+            y = std::max(y, skyline[j].y);
+        }
+        if (y + h <= size && (!found || y < bestY)) {
+            found = true;
+            bestSegment = i;
+            bestY = y;
+        }
+    }
+    return found;
+}
+
+/* Add a rectangle placed at segment index and height y to the skyline */
+static void addToSkyline(std::vector<SkylineSegment>& skyline, size_t index, GLuint y, GLuint w,
+                         GLuint h) {
+    const GLuint x = skyline[index].x;
+    skyline.insert(skyline.begin() + index, {x, y + h, w});
+
+    // Shorten or remove the segments now under the rectangle
+    for (size_t i = index + 1; i < skyline.size();) {
+        SkylineSegment& segment = skyline[i];
+        if (segment.x >= x + w) {
+            break;
+        }
+        const GLuint overlap = x + w - segment.x;
+        if (overlap >= segment.width) {
+            skyline.erase(skyline.begin() + i);
+        } else {
+            segment.x += overlap;
+            segment.width -= overlap;
+            break;
+        }
+    }
+
+    // Merge neighbors at the same height
+    for (size_t i = 0; i + 1 < skyline.size();) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Pack images of different sizes into as many atlases as needed */
+void TexturePacker::packAtlases(std::vector<int> indices, bool srgb) {
+    // Size of the cell of each image, including the gutter
+    auto cellWidth = [this](int i) {
+        return roundUpToMultiple(images_[i].width, gutter_) + 2 * gutter_;
+    };
+    auto cellHeight = [this](int i) {
+        return roundUpToMultiple(images_[i].height, gutter_) + 2 * gutter_;
+    };
+
+    std::stable_sort(indices.begin(), indices.end(),
+                     [&](int a, int b) { return cellHeight(a) > cellHeight(b); });
+
+    while (!indices.empty()) {
+        // Start with the smallest power of two which could hold all remaining images
+        double area = 0.0;
+        GLuint largest = 0;
+        for (int i : indices) {
+            area += static_cast<double>(cellWidth(i)) * cellHeight(i);
+            largest = std::max({largest, cellWidth(i), cellHeight(i)});
+        }
+        if (largest > maxAtlasSize_) {
+            std::cerr << "Image too large for the texture atlas ('"
+                      << images_[indices.front()].filename << "')\n";
+            indices.erase(indices.begin());
+            continue;
+        }
+        GLuint size = roundUpToPowerOfTwo(std::max(static_cast<GLuint>(std::sqrt(area)), largest));
+        size = std::min(size, maxAtlasSize_);
+
+        // Place the images, doubling the atlas size until all fit or the maximum is reached
+        std::vector<std::pair<int, std::pair<GLuint, GLuint>>> placed;
+        std::vector<int> rest;
+        for (;;) {
+            placed.clear();
+            rest.clear();
+            std::vector<SkylineSegment> skyline = {{0, 0, size}};
+            for (int i : indices) {
+                size_t segment = 0;
+                GLuint y = 0;
+                if (findPosition(skyline, size, cellWidth(i), cellHeight(i), segment, y)) {
+                    placed.push_back({i, {skyline[segment].x, y}});
+                    addToSkyline(skyline, segment, y, cellWidth(i), cellHeight(i));
+                } else {
+                    rest.push_back(i);
+                }
+            }
+            if (rest.empty() || size >= maxAtlasSize_) {
+                break;
+            }
+            size *= 2;
+        }
+
+        // Copy the images into the atlas, with their edge pixels repeated into the gutter
+        std::vector<GLubyte> atlas(4 * static_cast<size_t>(size) * size, 0);
+        for (const auto& [index, position] : placed) {
+            const Image& image = images_[index];
+            const GLuint cw = cellWidth(index);
+            const GLuint ch = cellHeight(index);
+            for (GLuint cy = 0; cy < ch; cy++) {
+                const GLuint sy = std::min(cy > gutter_ ? cy - gutter_ : 0, image.height - 1);
+                for (GLuint cx = 0; cx < cw; cx++) {
+                    const GLuint sx = std::min(cx > gutter_ ? cx - gutter_ : 0, image.width - 1);
+                    const size_t src = static_cast<size_t>(sy) * image.width + sx;
+                    const size_t dst =
+                        static_cast<size_t>(position.second + cy) * size + position.first + cx;
+                    std::copy_n(&image.rgba[4 * src], 4, &atlas[4 * dst]);
+                }
+            }
+        }
+
+        // Only the levels where the gutter is still at least one pixel wide
+        const GLsizei numLevels = 1 + static_cast<GLsizei>(std::log2(gutter_));
+        std::vector<std::vector<GLubyte>> levels;
+        levels.push_back(std::move(atlas));
+        GLuint w = size;
+        for (GLsizei level = 1; level < numLevels && w > 1; level++) {
+            mipmap::Level mip = mipmap::downsample(levels.back().data(), w, w, 4, srgb);
+            w = mip.width;
+            levels.push_back(std::move(mip.data));
+        }
+
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glstate::bindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        uploadLevels(GL_TEXTURE_2D, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, size, size, 1, levels);
+        textures_.push_back(texture);
+
+        for (const auto& [index, position] : placed) {
+            Placement& placement = placements_[index];
+            placement.target = GL_TEXTURE_2D;
+            placement.texture = texture;
+            placement.layer = 0;
+            const GLuint x = position.first + gutter_;
+            const GLuint y = position.second + gutter_;
+            const GLfloat scale = 1.0f / static_cast<GLfloat>(size);
+            placement.rect[0] = static_cast<GLfloat>(x) * scale;
+            placement.rect[1] = static_cast<GLfloat>(y) * scale;
+            placement.rect[2] = static_cast<GLfloat>(x + images_[index].width) * scale;
+            placement.rect[3] = static_cast<GLfloat>(y + images_[index].height) * scale;
+        }
+        indices = rest;
+    }
+}
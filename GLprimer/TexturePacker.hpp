@@ -0,0 +1,70 @@
+/*
+ * Packing of many textures into few texture objects, so that objects with different
+ * textures can be drawn without binding a new texture for each.
+ *
+ * Usage: Call add() for each TGA file, then pack() once to create the textures.
+ *        Images of the same size are stored as layers of a GL_TEXTURE_2D_ARRAY.
+ *        Images of other sizes are packed into GL_TEXTURE_2D atlases, with a border
+ *        of repeated edge pixels (the gutter) around each image, so that mipmap levels
+ *        do not blend neighboring images. Atlases get only the mipmap levels where the
+ *        gutter is at least one pixel wide.
+ *        placement() tells where each image ended up. For an array, sample the layer
+ *        with texture(sampler2DArray, vec3(uv, layer)). For an atlas, map texture
+ *        coordinates in [0,1] to rect with mix(rect.xy, rect.zw, uv). Images in an
+ *        atlas cannot repeat, so the uv should be clamped to [0,1] first.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <string>
+#include <vector>
+
+class TexturePacker {
+public:
+    struct Placement {
+        GLenum target = 0;   // GL_TEXTURE_2D_ARRAY or GL_TEXTURE_2D (atlas), 0 if not packed
+        GLuint texture = 0;  // Texture object holding the image
+        GLint layer = 0;     // Layer in an array texture, 0 for an atlas
+        GLfloat rect[4] = {0.0f, 0.0f, 1.0f, 1.0f};  // u0, v0, u1, v1 of the image
+    };
+
+    /*
+     * gutter is the border in pixels around images in an atlas, rounded up to a
+     * power of two. maxAtlasSize is the largest width and height of an atlas.
+     */
+    explicit TexturePacker(GLuint gutter = 4, GLuint maxAtlasSize = 4096);
+    ~TexturePacker();
+
+    TexturePacker(const TexturePacker&) = delete;
+    TexturePacker& operator=(const TexturePacker&) = delete;
+
+    // Load an image to be packed. Returns its index, or -1 if it could not be loaded.
+    int add(const std::string& filename);
+
+    // Create the array and atlas textures for all added images, and release the pixels
+    void pack(bool srgb = false);
+
+    const Placement& placement(int index) const;
+
+    // Number of texture objects created by pack()
+    size_t textureCount() const;
+
+private:
+    struct Image {
+        std::string filename;
+        GLuint width;
+        GLuint height;
+        std::vector<GLubyte> rgba;
+    };
+
+    void packArray(const std::vector<int>& indices, bool srgb);
+    void packAtlases(std::vector<int> indices, bool srgb);
+
+    GLuint gutter_;
+    GLuint maxAtlasSize_;
+    std::vector<Image> images_;
+    std::vector<Placement> placements_;
+    std::vector<GLuint> textures_;
+};
@@ -0,0 +1,97 @@
+/*
+ * Registry of shared textures and sampler objects
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "TextureRegistry.hpp"
+
+#include "GLState.hpp"
+#include "Utilities.hpp"
+
+TextureRegistry::~TextureRegistry() {
+    for (const auto& wraps : samplers_) {
+        for (GLuint sampler : wraps) {
+            if (sampler != 0) {
+                glstate::deleteSamplers(1, &sampler);
+            }
+        }
+    }
+}
+
+TextureRegistry::Handle TextureRegistry::acquire(const std::string& filename, bool srgb,
+                                                 Texture::Compression compression) {
+    const std::string path = util::canonicalPath(filename);
+    // The same image loaded with other options is a different texture
+    const std::string key = path + "|" + (srgb ? "srgb" : "linear") + "|" +
+                            std::to_string(static_cast<int>(compression));
+
+    auto it = textures_.find(key);
+    if (it != textures_.end()) {
+        if (Handle texture = it->second.lock()) {
+            return texture;
+        }
+    }
+
+    Handle texture = std::make_shared<Texture>(path, srgb, compression);
+    if (texture->id() == 0) {
+        return {};
+    }
+    textures_[key] = texture;
+    return texture;
+}
+
+GLuint TextureRegistry::sampler(Filter filter, Wrap wrap) {
+    GLuint& sampler = samplers_[static_cast<int>(filter)][static_cast<int>(wrap)];
+    if (sampler != 0) {
+        return sampler;
+    }
+
+    glGenSamplers(1, &sampler);
+    const GLint minFilter = (filter == Filter::Nearest)  ? GL_NEAREST
+                            : (filter == Filter::Linear) ? GL_LINEAR
+                                                         : GL_LINEAR_MIPMAP_LINEAR;
+    const GLint magFilter = (filter == Filter::Nearest) ? GL_NEAREST : GL_LINEAR;
+    const GLint wrapMode = (wrap == Wrap::Repeat)  ? GL_REPEAT
+                           : (wrap == Wrap::Clamp) ? GL_CLAMP_TO_EDGE
+                                                   : GL_MIRRORED_REPEAT;
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrapMode);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrapMode);
+    if (filter == Filter::Anisotropic && GLEW_EXT_texture_filter_anisotropic) {
+        GLfloat maxAnisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+    }
+    return sampler;
+}
+
+void TextureRegistry::bind(GLuint unit, const Handle& texture, Filter filter, Wrap wrap) {
+    if (texture) {
+        texture->bind(unit);
+    } else {
+        glstate::activeTexture(GL_TEXTURE0 + unit);
+        glstate::bindTexture(GL_TEXTURE_2D, 0);
+    }
+    glstate::bindSampler(unit, sampler(filter, wrap));
+}
+
+size_t TextureRegistry::size() const {
+    return util::countAlive(textures_);
+}
+
+size_t TextureRegistry::memoryUsage() const {
+    size_t bytes = 0;
+    for (const auto& entry : textures_) {
+        if (Handle texture = entry.second.lock()) {
+            bytes += texture->memoryUsage();
+        }
+    }
+    return bytes;
+}
+
+void TextureRegistry::purge() {
+    util::eraseExpired(textures_);
+}
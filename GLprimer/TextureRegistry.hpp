@@ -0,0 +1,69 @@
+/*
+ * A registry to share textures, and the sampler objects to sample them with.
+ *
+ * Usage: Call acquire() with a TGA or KTX file name to get a shared handle to the
+ *        texture. Textures are keyed by canonical path and load options, so each image
+ *        is loaded and stored on the GPU only once. The texture is deleted when the
+ *        last handle to it is released.
+ *        Call bind() to bind a texture to a texture unit together with one of the shared
+ *        sampler objects, or sampler() to get the sampler object for a filter and wrap
+ *        mode. Samplers override the sampling parameters of the texture, so switching
+ *        modes does not change any texture state.
+ *        The registry must be destroyed before the OpenGL context.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "Texture.hpp"
+
+class TextureRegistry {
+public:
+    using Handle = std::shared_ptr<Texture>;
+
+    enum class Filter {
+        Nearest,      // Nearest texel, no mipmaps
+        Linear,       // Bilinear, no mipmaps
+        Trilinear,    // Bilinear within and linear between mipmap levels
+        Anisotropic,  // Trilinear with the highest supported anisotropy
+    };
+    enum class Wrap { Repeat, Clamp, Mirror };
+
+    TextureRegistry() = default;
+    ~TextureRegistry();
+
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    // Return the texture for a file, loading it if it is not already loaded with the
+    // same options. Returns an empty handle if the file could not be loaded.
+    Handle acquire(const std::string& filename, bool srgb = false,
+                   Texture::Compression compression = Texture::Compression::None);
+
+    // Return the shared sampler object for a filter and wrap mode, creating it on first use
+    GLuint sampler(Filter filter = Filter::Trilinear, Wrap wrap = Wrap::Repeat);
+
+    // Bind a texture and a shared sampler object to a texture unit
+    void bind(GLuint unit, const Handle& texture, Filter filter = Filter::Trilinear,
+              Wrap wrap = Wrap::Repeat);
+
+    // Number of distinct textures currently alive
+    size_t size() const;
+
+    // GPU memory of all textures currently alive, in bytes
+    size_t memoryUsage() const;
+
+    // Forget entries whose textures have been released
+    void purge();
+
+private:
+    // Textures by canonical path and load options
+    std::unordered_map<std::string, std::weak_ptr<Texture>> textures_;
+    // Sampler objects by filter and wrap mode, 0 if not created yet
+    std::array<std::array<GLuint, 3>, 4> samplers_ = {};
+};
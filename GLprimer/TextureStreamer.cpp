@@ -0,0 +1,268 @@
+/*
+ * Asynchronous loading of textures through a persistently mapped pixel buffer.
+ *
+ * The staging buffer is used as a ring. Workers allocate a region for each decoded
+ * texture at the head of the ring and copy its levels there. update() uploads from the
+ * region and puts a fence after the upload. Regions are released when their fence is
+ * signaled, and the tail of the ring moves past the oldest released regions.
+ *
+ * This code is in the public domain.
+ */
+#include "TextureStreamer.hpp"
+
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Alignment of regions in the staging buffer
+static const size_t regionAlignment = 256;
+
+TextureStreamer::TextureStreamer(unsigned numThreads, size_t stagingSize)
+    : stagingSize_(stagingSize) {
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer_);
+        glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, stagingSize_, nullptr, flags);
+        mapped_ = static_cast<GLubyte*>(
+            glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, stagingSize_, flags));
+        glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (mapped_ == nullptr) {
+            std::cerr << "Could not map texture staging buffer, uploading from memory\n";
+            glstate::deleteBuffers(1, &buffer_);
+            buffer_ = 0;
+        }
+    }
+
+    if (numThreads == 0) {
+        // Leave one hardware thread for rendering
+        numThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads_.emplace_back(&TextureStreamer::worker, this);
+    }
+}
+
+TextureStreamer::~TextureStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    workAvailable_.notify_all();
+    spaceAvailable_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+
+    for (const Region& region : regions_) {
+        if (region.fence != nullptr) {
+            glDeleteSync(region.fence);
+        }
+    }
+    if (buffer_ != 0) {
+        glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glstate::deleteBuffers(1, &buffer_);
+    }
+}
+
+TextureStreamer::Handle TextureStreamer::load(const std::string& filename, bool srgb,
+                                              Texture::Compression compression) {
+    Handle texture = std::make_shared<Texture>();
+    texture->createPlaceholder();
+    // Remembered so that Texture::balanceMemory() can reload the texture
+    texture->filename_ = filename;
+    texture->srgb_ = srgb;
+    texture->compression_ = compression;
+
+    Job job;
+    job.texture = texture;
+    job.filename = filename;
+    job.srgb = srgb;
+    job.compression = compression;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_.push_back(std::move(job));
+    }
+    workAvailable_.notify_one();
+    return texture;
+}
+
+size_t TextureStreamer::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_.size() + loading_ + ready_.size();
+}
+
+/*
+ * Allocate a region at the head of the ring, waiting for update() to release older
+ * regions if there is not enough room. Returns false if the streamer is stopped.
+ */
+bool TextureStreamer::allocate(size_t size, size_t& offset, std::unique_lock<std::mutex>& lock) {
+    for (;;) {
+        if (stop_) {
+            return false;
+        }
+        if (regions_.empty()) {
+            head_ = 0;
+        }
+        const size_t tail = regions_.empty() ? stagingSize_ : regions_.front().offset;
+        if (regions_.empty() || head_ <= tail) {
+            // Free space is [head_, tail)
+            if (size <= tail - head_) {
+                break;
+            }
+        } else if (size <= stagingSize_ - head_) {
+            // Free space is [head_, end) and [0, tail)
+            break;
+        } else if (size <= tail) {
+            // Skip the end of the buffer with a region that is already free
+            regions_.push_back({head_, stagingSize_ - head_, true, nullptr});
+            head_ = 0;
+            break;
+        }
+        spaceAvailable_.wait(lock);
+    }
+    offset = head_;
+    regions_.push_back({head_, size, false, nullptr});
+    head_ += size;
+    return true;
+}
+
+/* Mark the region at offset as free, and move the tail past free regions */
+void TextureStreamer::release(size_t offset) {
+    for (Region& region : regions_) {
+        if (region.offset == offset && !region.free) {
+            region.free = true;
+            break;
+        }
+    }
+    while (!regions_.empty() && regions_.front().free) {
+        regions_.pop_front();
+    }
+    spaceAvailable_.notify_all();
+}
+
+/* Decode queued textures and copy them to the staging buffer */
+void TextureStreamer::worker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        workAvailable_.wait(lock, [this] { return stop_ || !queued_.empty(); });
+        if (stop_) {
+            return;
+        }
+        Job job = std::move(queued_.front());
+        queued_.pop_front();
+        loading_++;
+        lock.unlock();
+
+        // Textures which were released while queued are not loaded
+        bool loaded = !job.texture.expired() &&
+                      Texture::loadImage(job.filename, job.srgb, job.compression, job.image);
+
+        size_t total = 0;
+        for (size_t i = 0; i < job.image.numLevels(); i++) {
+            job.sizes.push_back(job.image.levelSize(i));
+            job.offsets.push_back(total);
+            total += (job.sizes.back() + regionAlignment - 1) & ~(regionAlignment - 1);
+        }
+
+        lock.lock();
+        if (loaded && mapped_ != nullptr && total <= stagingSize_) {
+            size_t offset = 0;
+            loaded = allocate(total, offset, lock);
+            if (loaded) {
+                lock.unlock();
+                // Cached levels are copied straight from the mapped KTX file
+                for (size_t i = 0; i < job.sizes.size(); i++) {
+                    job.offsets[i] += offset;
+                    std::memcpy(mapped_ + job.offsets[i], job.image.levelData(i), job.sizes[i]);
+                }
+                job.image.releaseData();
+                job.region = total;
+                lock.lock();
+            }
+        }
+        loading_--;
+        if (loaded) {
+            ready_.push_back(std::move(job));
+        }
+    }
+}
+
+void TextureStreamer::update(size_t maxBytes) {
+    std::vector<Job> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Release the regions which the GPU has finished reading
+        bool released = false;
+        for (Region& region : regions_) {
+            if (region.fence != nullptr) {
+                const GLenum status = glClientWaitSync(region.fence, 0, 0);
+                if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                    glDeleteSync(region.fence);
+                    region.fence = nullptr;
+                    region.free = true;
+                    released = true;
+                }
+            }
+        }
+        if (released) {
+            while (!regions_.empty() && regions_.front().free) {
+                regions_.pop_front();
+            }
+            spaceAvailable_.notify_all();
+        }
+
+        // Take ready textures up to the upload budget, but always at least one
+        size_t bytes = 0;
+        while (!ready_.empty() && (jobs.empty() || bytes < maxBytes)) {
+            for (size_t size : ready_.front().sizes) {
+                bytes += size;
+            }
+            jobs.push_back(std::move(ready_.front()));
+            ready_.pop_front();
+        }
+    }
+
+    for (Job& job : jobs) {
+        std::vector<Texture::LevelData> levels;
+        for (size_t i = 0; i < job.sizes.size(); i++) {
+            if (job.region != 0) {
+                // Offsets into the bound pixel unpack buffer are passed as pointers
+                levels.push_back({reinterpret_cast<const void*>(job.offsets[i]), job.sizes[i]});
+            } else {
+                levels.push_back({job.image.levelData(i), job.sizes[i]});
+            }
+        }
+
+        Handle texture = job.texture.lock();
+        if (texture != nullptr) {
+            if (job.region != 0) {
+                glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer_);
+            }
+            texture->uploadTexture(job.image, levels);
+            if (job.region != 0) {
+                glstate::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+        }
+
+        if (job.region != 0) {
+            const size_t offset = job.offsets.front();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (texture != nullptr) {
+                for (Region& region : regions_) {
+                    if (region.offset == offset && !region.free) {
+                        region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                        break;
+                    }
+                }
+            } else {
+                release(offset);
+            }
+        }
+    }
+}
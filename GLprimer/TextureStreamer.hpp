@@ -0,0 +1,98 @@
+/*
+ * Asynchronous loading of textures, to keep the frame time flat while they stream in.
+ *
+ * Usage: Create a TextureStreamer after the OpenGL context, and call load() to get a
+ *        handle to a texture which is loaded in the background. Until the image is
+ *        ready, the texture is a 1x1 gray placeholder, so it can be bound right away.
+ *        Call update() once per frame on the thread with the OpenGL context, and read
+ *        Texture::id() each frame, since it changes when the image arrives.
+ *        Worker threads decode the files and copy the mipmap levels into a persistently
+ *        mapped pixel buffer object (with GL 4.4 or ARB_buffer_storage). update() starts
+ *        the uploads from the buffer and uses fences to find out when the copied data
+ *        may be overwritten, so the transfers overlap rendering.
+ *        Without buffer storage, update() uploads from memory instead.
+ *        Destroy the TextureStreamer before the OpenGL context.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GL/glew.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "KTXFile.hpp"
+#include "Texture.hpp"
+
+class TextureStreamer {
+public:
+    using Handle = std::shared_ptr<Texture>;
+
+    /*
+     * numThreads = 0 uses one worker per hardware thread, minus one for rendering.
+     * stagingSize is the size of the pixel buffer which the workers fill.
+     */
+    explicit TextureStreamer(unsigned numThreads = 0, size_t stagingSize = 64 << 20);
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // Queue a texture for loading. The handle holds a placeholder until it is loaded.
+    Handle load(const std::string& filename, bool srgb = false,
+                Texture::Compression compression = Texture::Compression::None);
+
+    /*
+     * Upload textures that are ready, at most about maxBytes per call, and release
+     * staging memory that the GPU has finished reading. Call once per frame.
+     */
+    void update(size_t maxBytes = 16 << 20);
+
+    // Number of textures queued or loading, which are not yet uploaded
+    size_t pending() const;
+
+private:
+    struct Job {
+        std::weak_ptr<Texture> texture;
+        std::string filename;
+        bool srgb;
+        Texture::Compression compression;
+        KTXImage image;               // Level data is released once copied to the staging buffer
+        std::vector<size_t> offsets;  // Offsets of the levels in the staging buffer
+        std::vector<size_t> sizes;    // Sizes of the levels in bytes
+        size_t region = 0;            // Bytes allocated in the staging buffer, 0 if none
+    };
+
+    // Part of the staging buffer, in allocation order
+    struct Region {
+        size_t offset;
+        size_t size;
+        bool free;
+        GLsync fence;
+    };
+
+    void worker();
+    bool allocate(size_t size, size_t& offset, std::unique_lock<std::mutex>& lock);
+    void release(size_t offset);
+
+    mutable std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable spaceAvailable_;
+    std::deque<Job> queued_;     // Waiting for a worker
+    std::deque<Job> ready_;      // Decoded, waiting for update()
+    size_t loading_ = 0;         // Jobs being decoded by a worker
+    bool stop_ = false;
+
+    GLuint buffer_ = 0;          // Staging pixel unpack buffer
+    GLubyte* mapped_ = nullptr;  // Persistent mapping of buffer_, or nullptr if unsupported
+    size_t stagingSize_;
+    size_t head_ = 0;             // Next allocation
+    std::deque<Region> regions_;  // Allocated regions, oldest first
+
+    std::vector<std::thread> threads_;
+};
@@ -14,36 +14,112 @@
 #include <GL/glew.h>
 
 #include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <algorithm>
+#include <unordered_map>
+#include <utility>
 
+#include "GLState.hpp"
+#include "Shader.hpp"
 #include "TriangleSoup.hpp"
 
+// Index value that ends one triangle strip and starts the next one
+static const GLuint primitiveRestartIndex = 0xFFFFFFFF;
+
 /* Constructor: initialize a TriangleSoup object to an empty object */
-TriangleSoup::TriangleSoup() : vao_(0), vertexbuffer_(0), indexbuffer_(0), nverts_(0), ntris_(0) {}
+TriangleSoup::TriangleSoup()
+    : vao_(0)
+    , nverts_(0)
+    , ntris_(0)
+    , vertexbuffer_(0)
+    , indexbuffer_(0)
+    , stripbuffer_(0)
+    , positionvao_(0)
+    , positionbuffer_(0)
+    , attributebuffer_(0) {}
 
 /* Destructor: clean up allocated data in a TriangleSoup object */
 TriangleSoup::~TriangleSoup() { clean(); }
 
+/* Move constructor: take over the GL objects and data, leaving other empty */
+TriangleSoup::TriangleSoup(TriangleSoup&& other) noexcept
+    : vao_(std::exchange(other.vao_, 0))
+    , nverts_(std::exchange(other.nverts_, 0))
+    , ntris_(std::exchange(other.ntris_, 0))
+    , vertexbuffer_(std::exchange(other.vertexbuffer_, 0))
+    , indexbuffer_(std::exchange(other.indexbuffer_, 0))
+    , stripbuffer_(std::exchange(other.stripbuffer_, 0))
+    , positionvao_(std::exchange(other.positionvao_, 0))
+    , positionbuffer_(std::exchange(other.positionbuffer_, 0))
+    , attributebuffer_(std::exchange(other.attributebuffer_, 0))
+    , vertexarray_(std::move(other.vertexarray_))
+    , indexarray_(std::move(other.indexarray_))
+    , striparray_(std::move(other.striparray_))
+    , streams_(std::move(other.streams_))
+    , programvaos_(std::move(other.programvaos_)) {
+    other.vertexarray_.clear();
+    other.indexarray_.clear();
+    other.striparray_.clear();
+    other.streams_.clear();
+    other.programvaos_.clear();
+}
+
+/* Move assignment: release our own GL objects, then take over those of other */
+TriangleSoup& TriangleSoup::operator=(TriangleSoup&& other) noexcept {
+    if (this != &other) {
+        clean();
+        vao_ = std::exchange(other.vao_, 0);
+        nverts_ = std::exchange(other.nverts_, 0);
+        ntris_ = std::exchange(other.ntris_, 0);
+        vertexbuffer_ = std::exchange(other.vertexbuffer_, 0);
+        indexbuffer_ = std::exchange(other.indexbuffer_, 0);
+        stripbuffer_ = std::exchange(other.stripbuffer_, 0);
+        positionvao_ = std::exchange(other.positionvao_, 0);
+        positionbuffer_ = std::exchange(other.positionbuffer_, 0);
+        attributebuffer_ = std::exchange(other.attributebuffer_, 0);
+        vertexarray_ = std::move(other.vertexarray_);
+        indexarray_ = std::move(other.indexarray_);
+        striparray_ = std::move(other.striparray_);
+        streams_ = std::move(other.streams_);
+        programvaos_ = std::move(other.programvaos_);
+        other.vertexarray_.clear();
+        other.indexarray_.clear();
+        other.striparray_.clear();
+        other.streams_.clear();
+        other.programvaos_.clear();
+    }
+    return *this;
+}
+
 /* Clean up, remembering to de-allocate arrays and GL resources */
 void TriangleSoup::clean() {
+    deleteSplitStreams();
+
     if (glIsVertexArray(vao_)) {
-        glDeleteVertexArrays(1, &vao_);
+        glstate::deleteVertexArrays(1, &vao_);
         vao_ = 0;
     }
 
     if (glIsBuffer(vertexbuffer_)) {
-        glDeleteBuffers(1, &vertexbuffer_);
+        glstate::deleteBuffers(1, &vertexbuffer_);
         vertexbuffer_ = 0;
     }
 
     if (glIsBuffer(indexbuffer_)) {
-        glDeleteBuffers(1, &indexbuffer_);
+        glstate::deleteBuffers(1, &indexbuffer_);
         indexbuffer_ = 0;
     }
 
+    if (glIsBuffer(stripbuffer_)) {
+        glstate::deleteBuffers(1, &stripbuffer_);
+        stripbuffer_ = 0;
+    }
+
     vertexarray_.clear();
     indexarray_.clear();
+    striparray_.clear();
     nverts_ = 0;
     ntris_ = 0;
 }
@@ -78,49 +154,7 @@ void TriangleSoup::createTriangle() {
         indexarray_[i] = index_array_data[i];
     }
 
-    // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &(vao_));
-    glBindVertexArray(vao_);
-
-    // Generate two buffer IDs
-    glGenBuffers(1, &vertexbuffer_);
-    glGenBuffers(1, &indexbuffer_);
-
-    // Activate the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL (8 * nverts_)
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
-                 GL_STATIC_DRAW);
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 floats (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3 or 6 floats (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
-
-    // Activate the index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL (3 * ntris_)
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
-                 GL_STATIC_DRAW);
-
-    // Deactivate (unbind) the VAO and the buffers again.
-    // Do NOT unbind the index buffer while the VAO is still bound.
-    // The index buffer is an essential part of the VAO state.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    createBuffers();
 }
 
 /* Create a simple box geometry */
@@ -155,49 +189,7 @@ void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
         indexarray_[i] = index_array_data[i];
     }
 
-    // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &(vao_));
-    glBindVertexArray(vao_);
-
-    // Generate two buffer IDs
-    glGenBuffers(1, &vertexbuffer_);
-    glGenBuffers(1, &indexbuffer_);
-
-    // Activate the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL (8 * nverts_)
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
-                 GL_STATIC_DRAW);
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 floats (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3 or 6 floats (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
-
-    // Activate the index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL (3 * ntris_)
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
-                 GL_STATIC_DRAW);
-
-    // Deactivate (unbind) the VAO and the buffers again.
-    // Do NOT unbind the index buffer while the VAO is still bound.
-    // The index buffer is an essential part of the VAO state.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    createBuffers();
 }
 
 /*
@@ -304,50 +296,7 @@ void TriangleSoup::createSphere(float radius, int segments) {
         indexarray_[base + 3 * i + 2] = nverts_ - 3 - i;
     }
 
-    // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &(vao_));
-    glBindVertexArray(vao_);
-
-    // Generate two buffer IDs
-    glGenBuffers(1, &vertexbuffer_);
-    glGenBuffers(1, &indexbuffer_);
-
-    // Activate the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
-                 GL_STATIC_DRAW);
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3, 6 (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
-
-    // Activate the index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
-                 GL_STATIC_DRAW);
-
-    // Deactivate (unbind) the VAO and the buffers again.
-    // Note that the order of these operations matter:
-    // do NOT unbind the buffers while the VAO is still bound.
-    // The index buffer is an essential part of the VAO state.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    createBuffers();
 }
 
 /*
@@ -522,52 +471,275 @@ void TriangleSoup::readOBJ(const std::string& filename) {
         return;
     }
 
-    // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &vao_);
-    glBindVertexArray(vao_);
+    createBuffers();
+}
 
-    // Generate two buffer IDs
-    glGenBuffers(1, &vertexbuffer_);
-    glGenBuffers(1, &indexbuffer_);
+/*
+ * stripify()
+ *
+ * Convert the triangle list in indexarray_ into triangle strips.
+ * The strips are concatenated into striparray_, separated by a primitive
+ * restart index, and uploaded to a separate element buffer which replaces
+ * the triangle list in the VAO. The original index array is kept on the CPU.
+ *
+ * Strips are built greedily: starting from the first unused triangle, we walk
+ * across the shared edge at the end of the strip for as long as the neighbouring
+ * triangle is unused. A strip alternates the winding of every other triangle,
+ * so the neighbour has to contain the last edge in the direction matching the
+ * parity of its position in the strip. This keeps the original front faces.
+ * Each start triangle is tried in all three rotations and the longest walk wins.
+ */
+void TriangleSoup::stripify() {
+    if (ntris_ == 0 || !glIsVertexArray(vao_)) {
+        return;
+    }
+
+    // Map each directed edge (a -> b) to the triangle that contains it
+    auto edgeKey = [](GLuint a, GLuint b) { return (static_cast<uint64_t>(a) << 32) | b; };
+    std::unordered_map<uint64_t, int> edges;
+    edges.reserve(3 * ntris_);
+    for (int t = 0; t < ntris_; t++) {
+        for (int k = 0; k < 3; k++) {
+            edges[edgeKey(indexarray_[3 * t + k], indexarray_[3 * t + (k + 1) % 3])] = t;
+        }
+    }
 
-    // Activate the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
+    std::vector<char> used(ntris_, 0);  // Triangles already placed in a strip
+    std::vector<int> trial(ntris_, -1);  // Triangles visited by the current trial walk
+    int trialId = 0;
+
+    // Walk a strip starting with triangle t rotated by rot. Returns the number of
+    // triangles in the strip. If out is non-null, the strip indices are appended to it
+    // and the triangles of the strip are marked as used.
+    auto walk = [&](int t, int rot, std::vector<GLuint>* out) {
+        ++trialId;
+        const GLuint* tri = &indexarray_[3 * t];
+        GLuint p = tri[(rot + 1) % 3];
+        GLuint q = tri[(rot + 2) % 3];
+        trial[t] = trialId;
+        if (out) {
+            used[t] = 1;
+            out->push_back(tri[rot]);
+            out->push_back(p);
+            out->push_back(q);
+        }
+        int count = 1;
+        for (;;) {
+            // Even strip positions keep the winding (p, q, x), odd ones flip it to (q, p, x)
+            auto it = edges.find((count % 2 == 0) ? edgeKey(p, q) : edgeKey(q, p));
+            if (it == edges.end()) {
+                break;
+            }
+            const int n = it->second;
+            if (used[n] || trial[n] == trialId) {
+                break;
+            }
+            const GLuint* ntri = &indexarray_[3 * n];
+            int k = 0;
+            while (k < 3 && (ntri[k] == p || ntri[k] == q)) {
+                k++;
+            }
+            if (k == 3) {  // Degenerate triangle, end the strip here
+                break;
+            }
+            trial[n] = trialId;
+            if (out) {
+                used[n] = 1;
+                out->push_back(ntri[k]);
+            }
+            p = q;
+            q = ntri[k];
+            count++;
+        }
+        return count;
+    };
+
+    striparray_.clear();
+    striparray_.reserve(3 * ntris_);
+    std::vector<GLuint> strip;
+    int nstrips = 0;
+    for (int t = 0; t < ntris_; t++) {
+        if (used[t]) {
+            continue;
+        }
+        int bestRot = 0;
+        int bestCount = 0;
+        for (int rot = 0; rot < 3; rot++) {
+            const int count = walk(t, rot, nullptr);
+            if (count > bestCount) {
+                bestCount = count;
+                bestRot = rot;
+            }
+        }
+        strip.clear();
+        walk(t, bestRot, &strip);
+        if (nstrips > 0) {
+            striparray_.push_back(primitiveRestartIndex);
+        }
+        striparray_.insert(striparray_.end(), strip.begin(), strip.end());
+        nstrips++;
+    }
+
+    // Upload the strip indices and make them the element buffer of the VAO
+    deleteProgramVAOs();
+    if (stripbuffer_ == 0) {
+        glGenBuffers(1, &stripbuffer_);
+    }
+    glstate::bindVertexArray(vao_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stripbuffer_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, striparray_.size() * sizeof(GLuint), striparray_.data(),
                  GL_STATIC_DRAW);
+    if (positionvao_ != 0) {
+        glstate::bindVertexArray(positionvao_);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, stripbuffer_);
+    }
+    glstate::bindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
 
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3, 6 (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
+/*
+ * createBuffers()
+ *
+ * Create the VAO, the index buffer and the vertex buffer for the data in
+ * indexarray_ and vertexarray_. The vertex buffer uses the default format with
+ * all attributes as floats. Call setVertexFormat() afterwards for a leaner layout.
+ */
+void TriangleSoup::createBuffers() {
+    // Generate one vertex array object (VAO) and bind it
+    glGenVertexArrays(1, &vao_);
+    glstate::bindVertexArray(vao_);
 
     // Activate the index buffer
+    glGenBuffers(1, &indexbuffer_);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL
+    // Present our vertex indices to OpenGL (3 * ntris_)
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
                  GL_STATIC_DRAW);
 
     // Deactivate (unbind) the VAO and the buffers again.
-    // Do NOT unbind the buffers while the VAO is still bound.
+    // Do NOT unbind the index buffer while the VAO is still bound.
     // The index buffer is an essential part of the VAO state.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glstate::bindVertexArray(0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    return;
+    setVertexFormat<DefaultVertexFormat>();
+}
+
+/* Upload packed vertex data to a buffer, which is created if it does not exist */
+void TriangleSoup::uploadStream(GLuint& buffer, const VertexStream& stream) {
+    if (buffer == 0) {
+        glGenBuffers(1, &buffer);
+    }
+    glstate::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, stream.data.size(), stream.data.data(), GL_STATIC_DRAW);
+    glstate::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*
+ * setAttributes(GLuint vao, const StreamLayout& stream, uint32_t mask)
+ *
+ * Enable and specify the attributes of a stream in a VAO, those whose location
+ * bits are set in mask. The element buffer binding of the VAO is left unchanged.
+ */
+void TriangleSoup::setAttributes(GLuint vao, const StreamLayout& stream, uint32_t mask) {
+    glstate::bindVertexArray(vao);
+    glstate::bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    for (const VertexAttribute& attrib : stream.attributes) {
+        if (attrib.location >= 32 || (mask & (1u << attrib.location)) == 0) {
+            continue;
+        }
+        glEnableVertexAttribArray(attrib.location);
+        // (location, components, type, normalized, stride, offset into first vertex)
+        glVertexAttribPointer(attrib.location, attrib.size, attrib.type, attrib.normalized,
+                              stream.stride, (void*)static_cast<size_t>(attrib.offset));
+    }
+    glstate::bindVertexArray(0);
+    glstate::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/* Disable all attributes of the main VAO before a new layout is specified */
+void TriangleSoup::disableAttributes() {
+    glstate::bindVertexArray(vao_);
+    for (GLuint location = 0; location < 16; location++) {
+        glDisableVertexAttribArray(location);
+    }
+    glstate::bindVertexArray(0);
+}
+
+/* Remove the split streams and the position-only VAO, if any */
+void TriangleSoup::deleteSplitStreams() {
+    deleteProgramVAOs();
+    if (glIsVertexArray(positionvao_)) {
+        glstate::deleteVertexArrays(1, &positionvao_);
+        positionvao_ = 0;
+    }
+
+    if (glIsBuffer(positionbuffer_)) {
+        glstate::deleteBuffers(1, &positionbuffer_);
+        positionbuffer_ = 0;
+    }
+
+    if (glIsBuffer(attributebuffer_)) {
+        glstate::deleteBuffers(1, &attributebuffer_);
+        attributebuffer_ = 0;
+    }
+}
+
+/*
+ * setVertexFormat(const VertexStream& stream)
+ *
+ * Replace the vertex buffer with data packed in another format. Attributes
+ * which are not part of the format are disabled in the VAO, so they are
+ * neither stored nor fetched.
+ */
+void TriangleSoup::setVertexFormat(const VertexStream& stream) {
+    if (!glIsVertexArray(vao_)) {
+        return;
+    }
+
+    deleteSplitStreams();
+    disableAttributes();
+    uploadStream(vertexbuffer_, stream);
+    streams_ = {{vertexbuffer_, stream.stride, stream.attributes}};
+    setAttributes(vao_, streams_[0]);
+}
+
+/*
+ * splitStreams(const VertexStream& positions, const VertexStream& attributes)
+ *
+ * Replace the interleaved vertex buffer with two streams: positions in one
+ * buffer and the remaining attributes in another. The main VAO reads from both,
+ * so render() is unaffected. A second VAO reads only the position stream, which
+ * makes a depth-only pass fetch 12 instead of 32 bytes per vertex with the
+ * default formats.
+ */
+void TriangleSoup::splitStreams(const VertexStream& positions, const VertexStream& attributes) {
+    if (nverts_ == 0 || !glIsVertexArray(vao_) || positionbuffer_ != 0) {
+        return;
+    }
+
+    uploadStream(positionbuffer_, positions);
+    uploadStream(attributebuffer_, attributes);
+
+    // Point the attributes of the main VAO to the two new streams
+    deleteProgramVAOs();
+    disableAttributes();
+    streams_ = {{positionbuffer_, positions.stride, positions.attributes},
+                {attributebuffer_, attributes.stride, attributes.attributes}};
+    setAttributes(vao_, streams_[0]);
+    setAttributes(vao_, streams_[1]);
+
+    // The position-only VAO shares the position stream and the element buffer
+    glGenVertexArrays(1, &positionvao_);
+    setAttributes(positionvao_, streams_[0]);
+    glstate::bindVertexArray(positionvao_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (stripbuffer_ != 0) ? stripbuffer_ : indexbuffer_);
+    glstate::bindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // The interleaved buffer is no longer referenced by any VAO
+    glstate::deleteBuffers(1, &vertexbuffer_);
+    vertexbuffer_ = 0;
 }
 
 /* Print data from a TriangleSoup object, for debugging purposes */
@@ -589,6 +761,11 @@ void TriangleSoup::printInfo() {
     printf("TriangleSoup information:\n");
     printf("vertices : %d\n", nverts_);
     printf("triangles: %d\n", ntris_);
+    if (!striparray_.empty()) {
+        printf("strip indices: %d (%.2f per triangle, %d for a triangle list)\n",
+               static_cast<int>(striparray_.size()),
+               static_cast<double>(striparray_.size()) / ntris_, 3 * ntris_);
+    }
     float xmin = vertexarray_[0];
     float xmax = xmin;
     float ymin = vertexarray_[1];
@@ -617,10 +794,93 @@ void TriangleSoup::printInfo() {
     printf("zmax: %8.2f\n", zmax);
 }
 
-/* Render the geometry in a TriangleSoup object */
+/*
+ * Render the geometry in a TriangleSoup object. The VAO is left bound, so that
+ * rendering the same mesh again does not bind it again (see GLState.hpp).
+ */
 void TriangleSoup::render() {
-    glBindVertexArray(vao_);
-    glDrawElements(GL_TRIANGLES, 3 * ntris_, GL_UNSIGNED_INT, (void*)0);
-    // (mode, vertex count, type, element array buffer offset)
-    glBindVertexArray(0);
+    glstate::bindVertexArray(vao_);
+    drawElements();
+}
+
+/* Render the geometry using only the position stream */
+void TriangleSoup::renderPositionOnly() {
+    glstate::bindVertexArray((positionvao_ != 0) ? positionvao_ : vao_);
+    drawElements();
+}
+
+GLuint TriangleSoup::vao() const { return vao_; }
+
+int TriangleSoup::numTriangles() const { return ntris_; }
+
+void TriangleSoup::render(const Shader& shader) {
+    glstate::bindVertexArray(programVAO(shader));
+    drawElements();
+}
+
+/*
+ * The VAO for the attributes a program reads. The first time a set of attributes is
+ * seen, it is checked against the mesh, and a VAO is made if the program reads fewer
+ * attributes than the main VAO enables.
+ */
+GLuint TriangleSoup::programVAO(const Shader& shader) {
+    const uint32_t mask = shader.attributeMask();
+    for (const auto& [programMask, vao] : programvaos_) {
+        if (programMask == mask) {
+            return vao;
+        }
+    }
+
+    uint32_t provided = 0;
+    for (const StreamLayout& stream : streams_) {
+        for (const VertexAttribute& attrib : stream.attributes) {
+            provided |= (attrib.location < 32) ? 1u << attrib.location : 0;
+        }
+    }
+    for (const Shader::Attribute& attribute : shader.attributes()) {
+        const GLuint location = static_cast<GLuint>(attribute.location);
+        if (location >= 32 || (provided & (1u << location)) == 0) {
+            std::cerr << "The shader reads the attribute '" << attribute.name << "' at location "
+                      << location << ", which the mesh does not provide\n";
+        }
+    }
+
+    GLuint vao = vao_;
+    if ((mask & provided) == 1u && positionvao_ != 0) {
+        vao = positionvao_;  // Positions only, from the split position stream
+    } else if ((provided & ~mask) != 0 && vao_ != 0) {
+        glGenVertexArrays(1, &vao);
+        for (const StreamLayout& stream : streams_) {
+            setAttributes(vao, stream, mask);
+        }
+        glstate::bindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (stripbuffer_ != 0) ? stripbuffer_ : indexbuffer_);
+    }
+    programvaos_.emplace_back(mask, vao);
+    return vao;
+}
+
+/* Delete the VAOs made for programs, which have to be remade when the buffers change */
+void TriangleSoup::deleteProgramVAOs() {
+    for (const auto& [mask, vao] : programvaos_) {
+        if (vao != vao_ && vao != positionvao_) {
+            glstate::deleteVertexArrays(1, &vao);
+        }
+    }
+    programvaos_.clear();
+}
+
+/* Draw the triangle list, or the triangle strips if stripify() was called */
+void TriangleSoup::drawElements() {
+    if (!striparray_.empty()) {
+        // Triangle strips, separated by the restart index
+        glstate::enable(GL_PRIMITIVE_RESTART);
+        glstate::primitiveRestartIndex(primitiveRestartIndex);
+        glDrawElements(GL_TRIANGLE_STRIP, static_cast<GLsizei>(striparray_.size()),
+                       GL_UNSIGNED_INT, (void*)0);
+    } else {
+        glstate::disable(GL_PRIMITIVE_RESTART);
+        glDrawElements(GL_TRIANGLES, 3 * ntris_, GL_UNSIGNED_INT, (void*)0);
+        // (mode, vertex count, type, element array buffer offset)
+    }
 }
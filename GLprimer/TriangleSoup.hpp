@@ -5,7 +5,12 @@
  *        descriptions.
  *        The method loadOBJ() loads geometry from an OBJ file. Only the mesh is loaded. Material
  *        information is ignored. Only triangles are supported. OBJ files with quads are rejected.
- *        Call render() to draw the mesh in OpenGL.
+ *        Call render() to draw the mesh in OpenGL. Its VAO is left bound, so use
+ *        glstate::bindVertexArray() for other VAOs (see GLState.hpp).
+ *        Call render(shader) to fetch only the attributes the shader reads. The mesh
+ *        provides position, normal and texcoord at locations 0, 1 and 2.
+ *        Call setVertexFormat<Format>() to store only the attributes a shader consumes,
+ *        see VertexFormat.hpp.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2013-2014
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -15,9 +20,15 @@
 #pragma once
 
 #include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "VertexFormat.hpp"
+
+class Shader;
+
 // A class to hold geometry data and send it off for rendering
 class TriangleSoup {
 public:
@@ -27,6 +38,13 @@ public:
     /* Destructor: clean up allocated data in a triangleSoup object */
     ~TriangleSoup();
 
+    /* A triangleSoup owns its GL objects. It can be moved, e.g. into a std::vector,
+     * but not copied, since two copies would delete the same GL objects. */
+    TriangleSoup(const TriangleSoup&) = delete;
+    TriangleSoup& operator=(const TriangleSoup&) = delete;
+    TriangleSoup(TriangleSoup&& other) noexcept;
+    TriangleSoup& operator=(TriangleSoup&& other) noexcept;
+
     /* Clean up allocated data in a triangleSoup object */
     void clean();
 
@@ -42,6 +60,27 @@ public:
     /* Load geometry from an OBJ file */
     void readOBJ(const std::string& filename);
 
+    /* Convert the triangle list to triangle strips joined by primitive restart.
+     * After this call, render() draws GL_TRIANGLE_STRIP instead of GL_TRIANGLES. */
+    void stripify();
+
+    /* Re-upload the vertex data in another layout. The CPU copy of the vertex data
+     * keeps all attributes, so the format can be changed again later. */
+    template <typename Format>
+    void setVertexFormat() {
+        setVertexFormat(Format::pack(vertexarray_.data(), nverts_));
+    }
+
+    /* Split the vertex data into two streams: tightly packed positions (attribute 0)
+     * in one buffer, the other attributes in another. This also creates a
+     * position-only VAO for renderPositionOnly(). */
+    template <typename PositionFormat = VertexFormat<Position<>>,
+              typename AttributeFormat = VertexFormat<Normal<>, Texcoord<>>>
+    void splitStreams() {
+        splitStreams(PositionFormat::pack(vertexarray_.data(), nverts_),
+                     AttributeFormat::pack(vertexarray_.data(), nverts_));
+    }
+
     /* Print data from a triangleSoup object, for debugging purposes */
     void print();
 
@@ -51,14 +90,59 @@ public:
     /* Render the geometry in a triangleSoup object */
     void render();
 
+    /* Render with a VAO which enables only the attributes the shader reads, so that
+     * unused attributes are not fetched. Warns once about attributes the shader reads
+     * which the mesh does not provide. */
+    void render(const Shader& shader);
+
+    /* Render only the vertex positions, for depth prepasses and shadow maps.
+     * Only the position stream is fetched if splitStreams() has been called. */
+    void renderPositionOnly();
+
+    /* The vertex array object used by render(), for sorting draws by mesh */
+    GLuint vao() const;
+
+    /* Number of triangles, 0 if no geometry has been loaded */
+    int numTriangles() const;
+
 private:
     void printError(const char* errtype, const char* errmsg);
 
+    /* Issue the draw call for the currently bound VAO */
+    void drawElements();
+
+    /* Create the VAO and buffers for indexarray_ and vertexarray_ */
+    void createBuffers();
+
+    // A vertex buffer and the attributes in it
+    struct StreamLayout {
+        GLuint buffer;
+        GLsizei stride;
+        std::vector<VertexAttribute> attributes;
+    };
+
+    void uploadStream(GLuint& buffer, const VertexStream& stream);
+    void setAttributes(GLuint vao, const StreamLayout& stream, uint32_t mask = ~0u);
+    void disableAttributes();
+    void deleteSplitStreams();
+    GLuint programVAO(const Shader& shader);
+    void deleteProgramVAOs();
+    void setVertexFormat(const VertexStream& stream);
+    void splitStreams(const VertexStream& positions, const VertexStream& attributes);
+
     GLuint vao_;                        // Vertex array object, the main handle for geometry
     int nverts_;                        // Number of vertices in the vertex array
     int ntris_;                         // Number of triangles in the index array (may be zero)
     GLuint vertexbuffer_;               // Buffer ID to bind to GL_ARRAY_BUFFER
     GLuint indexbuffer_;                // Buffer ID to bind to GL_ELEMENT_ARRAY_BUFFER
+    GLuint stripbuffer_;                // Buffer ID for the strip indices (0 if not stripified)
+    GLuint positionvao_;                // VAO with only the position stream (0 if not split)
+    GLuint positionbuffer_;             // Buffer ID for packed positions x y z (0 if not split)
+    GLuint attributebuffer_;            // Buffer ID for packed nx ny nz s t (0 if not split)
     std::vector<GLfloat> vertexarray_;  // Vertex array on interleaved format: x y z nx ny nz s t
     std::vector<GLuint> indexarray_;    // Element index array
+    std::vector<GLuint> striparray_;    // Strip index array, strips separated by a restart index
+    std::vector<StreamLayout> streams_;  // The vertex streams of the main VAO
+    // VAOs with only the attributes read by programs, by their attribute masks
+    std::vector<std::pair<uint32_t, GLuint>> programvaos_;
 };
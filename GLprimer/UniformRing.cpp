@@ -0,0 +1,156 @@
+/*
+ * Uniform data streamed through a persistently mapped buffer.
+ *
+ * The buffer holds framesInFlight parts of frameSize bytes. A frame writes its uniform
+ * data into one part, from the start, and endFrame() puts a fence after the draw calls
+ * which read it. The next frame to use the part waits for that fence first.
+ *
+ * This code is in the public domain.
+ */
+#include "UniformRing.hpp"
+
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+// The structs must match the std140 layout of the blocks in glslSource()
+static_assert(sizeof(UniformRing::FrameData) == 160, "FrameData does not match std140");
+static_assert(sizeof(UniformRing::LightData) == 64, "LightData does not match std140");
+static_assert(sizeof(UniformRing::ObjectData) == 176, "ObjectData does not match std140");
+
+UniformRing::UniformRing(size_t frameSize, unsigned framesInFlight)
+    : frameSize_(frameSize)
+    , frames_(std::clamp(framesInFlight, 1u, maxFramesInFlight)) {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    alignment_ = static_cast<size_t>(std::max(alignment, 1));
+    frameSize_ = (frameSize_ + alignment_ - 1) / alignment_ * alignment_;
+    const GLsizeiptr size = static_cast<GLsizeiptr>(frameSize_ * frames_);
+
+    glGenBuffers(1, &buffer_);
+    glstate::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+        mapped_ = static_cast<GLubyte*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+        if (mapped_ == nullptr) {
+            std::cerr << "Could not map uniform buffer, uploading with glBufferSubData()\n";
+            glstate::deleteBuffers(1, &buffer_);
+            glGenBuffers(1, &buffer_);
+            glstate::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        }
+    }
+    if (mapped_ == nullptr) {
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glstate::bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRing::~UniformRing() {
+    for (GLsync fence : fences_) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+        }
+    }
+    if (mapped_ != nullptr) {
+        glstate::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glstate::bindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glstate::deleteBuffers(1, &buffer_);
+}
+
+void UniformRing::beginFrame() {
+    frame_ = (frame_ + 1) % frames_;
+    offset_ = 0;
+    full_ = false;
+
+    // Wait until the GPU has finished the draw calls of the frame which used this part
+    GLsync& fence = fences_[frame_];
+    if (fence != nullptr) {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED) {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1 ms
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void UniformRing::endFrame() {
+    // Only a mapped buffer is written while the GPU may read it
+    if (mapped_ != nullptr) {
+        fences_[frame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+bool UniformRing::bind(GLuint binding, const void* data, size_t size) {
+    if (offset_ + size > frameSize_) {
+        if (!full_) {
+            std::cerr << "Uniform ring full, increase the frame size (" << frameSize_
+                      << " bytes)\n";
+            full_ = true;
+        }
+        return false;
+    }
+    const size_t offset = frame_ * frameSize_ + offset_;
+    if (mapped_ != nullptr) {
+        std::memcpy(mapped_ + offset, data, size);
+    } else {
+        glstate::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(offset),
+                        static_cast<GLsizeiptr>(size), data);
+    }
+    glstate::bindBufferRange(GL_UNIFORM_BUFFER, binding, buffer_,
+                             static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+    offset_ += (size + alignment_ - 1) / alignment_ * alignment_;
+    return true;
+}
+
+bool UniformRing::bind(const FrameData& data) { return bind(FrameBinding, &data, sizeof(data)); }
+
+bool UniformRing::bind(const LightData& data) { return bind(LightBinding, &data, sizeof(data)); }
+
+bool UniformRing::bind(const ObjectData& data) {
+    return bind(ObjectBinding, &data, sizeof(data));
+}
+
+void UniformRing::bindBlocks(GLuint program) {
+    const std::pair<const char*, GLuint> blocks[] = {
+        {"Frame", FrameBinding}, {"Light", LightBinding}, {"Object", ObjectBinding}};
+    for (const auto& block : blocks) {
+        const GLuint index = glGetUniformBlockIndex(program, block.first);
+        if (index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, index, block.second);
+        }
+    }
+}
+
+const char* UniformRing::glslSource() {
+    return R"glsl(
+layout(std140) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    vec4 cameraPosition;
+    float time;
+};
+
+layout(std140) uniform Light {
+    vec4 lightPosition;  // In view coordinates, w = 0 for a directional light
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+};
+
+layout(std140) uniform Object {
+    mat4 model;
+    mat4 normalMatrix;
+    vec4 diffuseColor;
+    vec4 specularColor;
+    float shininess;
+};
+)glsl";
+}
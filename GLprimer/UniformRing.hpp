@@ -0,0 +1,101 @@
+/*
+ * Per-frame uniform data in a ring of uniform buffer memory.
+ *
+ * Usage: Create a UniformRing after the OpenGL context. Paste glslSource() into the
+ *        shaders, after the #version line, and call bindBlocks() once for each program.
+ *        Each frame:
+ *         - call beginFrame()
+ *         - fill a FrameData and a LightData and bind them with bind()
+ *         - for each object, fill an ObjectData, bind it with bind() and draw
+ *         - call endFrame()
+ *        bind() copies the struct into the ring and binds that range to the binding
+ *        point of the block with glBindBufferRange(), so an object costs one copy and
+ *        one GL call instead of a glUniform*() call per value.
+ *        With GL 4.4 or ARB_buffer_storage the buffer is persistently mapped, and the
+ *        ring is split into one part per frame in flight. beginFrame() waits for the
+ *        fence of the frame which last used the part, which rarely has to wait.
+ *        Without buffer storage, each bind() uploads with glBufferSubData().
+ *        The structs follow the std140 layout of the blocks in glslSource(). Matrices
+ *        are column-major, and vec3 values are padded to vec4.
+ *        Destroy the UniformRing before the OpenGL context.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GL/glew.h>
+#include <array>
+#include <cstddef>
+
+class UniformRing {
+public:
+    // Binding points of the uniform blocks
+    enum Binding : GLuint { FrameBinding = 0, LightBinding = 1, ObjectBinding = 2 };
+
+    // layout(std140) uniform Frame
+    struct alignas(16) FrameData {
+        GLfloat view[16];
+        GLfloat projection[16];
+        GLfloat cameraPosition[4];  // xyz, w unused
+        GLfloat time;
+        GLfloat padding[3];
+    };
+
+    // layout(std140) uniform Light, for the Phong lighting model
+    struct alignas(16) LightData {
+        GLfloat position[4];  // In view coordinates, w = 0 for a directional light
+        GLfloat ambient[4];   // rgb, a unused
+        GLfloat diffuse[4];
+        GLfloat specular[4];
+    };
+
+    // layout(std140) uniform Object
+    struct alignas(16) ObjectData {
+        GLfloat model[16];
+        GLfloat normalMatrix[16];  // Inverse transpose of view * model, as a mat4
+        GLfloat diffuseColor[4];
+        GLfloat specularColor[4];
+        GLfloat shininess;
+        GLfloat padding[3];
+    };
+
+    /*
+     * frameSize is the bytes of uniform data per frame, framesInFlight the number of
+     * frames which the GPU may still be reading from when a new one begins (at most 8).
+     */
+    explicit UniformRing(size_t frameSize = 4 << 20, unsigned framesInFlight = 3);
+    ~UniformRing();
+
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+
+    void beginFrame();
+    void endFrame();
+
+    // Copy data into the ring and bind it to the block. Returns false if the frame is full.
+    bool bind(const FrameData& data);
+    bool bind(const LightData& data);
+    bool bind(const ObjectData& data);
+
+    // Copy size bytes into the ring and bind them to a binding point, for other blocks
+    bool bind(GLuint binding, const void* data, size_t size);
+
+    // Set the binding points of the blocks Frame, Light and Object in a program
+    static void bindBlocks(GLuint program);
+
+    // GLSL declarations of the blocks Frame, Light and Object
+    static const char* glslSource();
+
+private:
+    static constexpr unsigned maxFramesInFlight = 8;
+
+    GLuint buffer_ = 0;
+    GLubyte* mapped_ = nullptr;  // Persistently mapped buffer, nullptr without buffer storage
+    size_t frameSize_;
+    size_t alignment_;           // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    unsigned frames_;
+    unsigned frame_ = 0;  // Part of the ring used by the current frame
+    size_t offset_ = 0;   // Next free byte in the part of the current frame
+    bool full_ = false;
+    std::array<GLsync, maxFramesInFlight> fences_ = {};  // One per frame in flight
+};
@@ -10,7 +10,21 @@
 
 #include <GLFW/glfw3.h>
 #include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <fstream>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UTIL_SIMD_X86 1
+#define UTIL_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define UTIL_SIMD_X86 1
+#define UTIL_TARGET(isa)
+#endif
 
 namespace util {
 
@@ -42,4 +56,153 @@ double displayFPS(GLFWwindow* window) {
     return fps;
 }
 
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;  // 64-bit FNV prime
+    }
+    return hash;
+}
+
+#if defined(UTIL_SIMD_X86)
+
+// Byte shuffle that swaps bytes 0 and 2 of each 4-byte pixel
+#define UTIL_SHUFFLE_RGBA 15, 12, 13, 14, 11, 8, 9, 10, 7, 4, 5, 6, 3, 0, 1, 2
+
+// Shuffle masks for 16 pixels of 3 bytes in three 16-byte registers. Output register j
+// takes bytes from input registers j-1, j and j+1, so rgbShuffle[j][r] selects the bytes
+// from register r and zeroes the others (0x80). Separate loads avoid overlapping stores.
+struct RGBShuffle {
+    alignas(16) signed char mask[3][3][16];
+    constexpr RGBShuffle() : mask() {
+        for (int j = 0; j < 3; j++) {
+            for (int k = 0; k < 16; k++) {
+                const int out = 16 * j + k;
+                const int in = out - out % 3 + 2 - out % 3;  // Swap bytes 0 and 2 of the pixel
+                for (int r = 0; r < 3; r++) {
+                    mask[j][r][k] = (in / 16 == r) ? static_cast<signed char>(in % 16)
+                                                   : static_cast<signed char>(0x80);
+                }
+            }
+        }
+    }
+};
+static constexpr RGBShuffle rgbShuffle;
+
+UTIL_TARGET("ssse3")
+static size_t swapRedBlueSSSE3(unsigned char* pixels, size_t size, int bytesPerPixel) {
+    size_t i = 0;
+    if (bytesPerPixel == 4) {
+        const __m128i shuffle = _mm_set_epi8(UTIL_SHUFFLE_RGBA);
+        for (; i + 16 <= size; i += 16) {
+            __m128i* p = reinterpret_cast<__m128i*>(pixels + i);
+            _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), shuffle));
+        }
+    } else {
+        __m128i mask[3][3];
+        for (int j = 0; j < 3; j++) {
+            for (int r = 0; r < 3; r++) {
+                mask[j][r] =
+                    _mm_load_si128(reinterpret_cast<const __m128i*>(rgbShuffle.mask[j][r]));
+            }
+        }
+        for (; i + 48 <= size; i += 48) {
+            __m128i* p = reinterpret_cast<__m128i*>(pixels + i);
+            const __m128i in[3] = {_mm_loadu_si128(p), _mm_loadu_si128(p + 1),
+                                   _mm_loadu_si128(p + 2)};
+            for (int j = 0; j < 3; j++) {
+                __m128i out = _mm_shuffle_epi8(in[j], mask[j][j]);
+                if (j > 0) {
+                    out = _mm_or_si128(out, _mm_shuffle_epi8(in[j - 1], mask[j][j - 1]));
+                }
+                if (j < 2) {
+                    out = _mm_or_si128(out, _mm_shuffle_epi8(in[j + 1], mask[j][j + 1]));
+                }
+                _mm_storeu_si128(p + j, out);
+            }
+        }
+    }
+    return i;
+}
+
+UTIL_TARGET("avx2")
+static size_t swapRedBlueAVX2(unsigned char* pixels, size_t size) {
+    const __m256i shuffle = _mm256_set_epi8(UTIL_SHUFFLE_RGBA, UTIL_SHUFFLE_RGBA);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i* p = reinterpret_cast<__m256i*>(pixels + i);
+        _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), shuffle));
+    }
+    return i;
+}
+
+static bool cpuHasSSSE3() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static bool cpuHasAVX2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+void swapRedBlue(unsigned char* pixels, size_t numPixels, int bytesPerPixel) {
+    const size_t size = numPixels * bytesPerPixel;
+    size_t i = 0;  // Number of bytes converted by a SIMD kernel
+
+#if defined(UTIL_SIMD_X86)
+    static const bool hasSSSE3 = cpuHasSSSE3();
+    static const bool hasAVX2 = cpuHasAVX2();
+    if (bytesPerPixel == 4 && hasAVX2) {
+        i = swapRedBlueAVX2(pixels, size);
+    }
+    if (hasSSSE3) {
+        i += swapRedBlueSSSE3(pixels + i, size - i, bytesPerPixel);
+    }
+#endif
+
+    // Convert the remaining pixels one at a time
+    for (; i < size; i += bytesPerPixel) {
+        std::swap(pixels[i], pixels[i + 2]);
+    }
+}
+
+bool readFileBytes(const std::string& filename, std::vector<char>& contents) {
+    std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    in.seekg(0, std::ios_base::end);
+    const std::streamoff fileLength = in.tellg();
+    in.seekg(0);
+    if (fileLength < 0) {
+        return false;
+    }
+    contents.resize(static_cast<size_t>(fileLength));
+    in.read(contents.data(), fileLength);
+    return !in.bad() && in.gcount() == fileLength;
+}
+
+std::string canonicalPath(const std::string& filename) {
+    std::error_code ec;
+    const std::filesystem::path path = std::filesystem::weakly_canonical(filename, ec);
+    return ec ? filename : path.string();
+}
+
 }  // namespace util
@@ -8,6 +8,11 @@
  */
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 struct GLFWwindow;
 
 namespace util {
@@ -23,4 +28,56 @@ namespace util {
  */
 double displayFPS(GLFWwindow* window);
 
+/*
+ * hashBytes() - 64-bit FNV-1a hash of a block of memory.
+ * Pass the result of a previous call as seed to hash data in several pieces.
+ */
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+/*
+ * readFileBytes() - Read the entire contents of a binary file.
+ * Returns false if the file could not be opened or read.
+ */
+bool readFileBytes(const std::string& filename, std::vector<char>& contents);
+
+/*
+ * canonicalPath() - Canonical form of a path, so that "dir/../dir/x" and "dir/x" give
+ * the same string, for use as a cache key. Returns the path as given if it cannot be
+ * resolved.
+ */
+std::string canonicalPath(const std::string& filename);
+
+/*
+ * countAlive(), eraseExpired() - Count or remove the entries of a map of std::weak_ptr
+ * values whose objects have been released, for caches of shared resources.
+ */
+template <typename Map>
+size_t countAlive(const Map& map) {
+    size_t count = 0;
+    for (const auto& entry : map) {
+        if (!entry.second.expired()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+template <typename Map>
+void eraseExpired(Map& map) {
+    for (auto it = map.begin(); it != map.end();) {
+        if (it->second.expired()) {
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/*
+ * swapRedBlue() - Convert pixels between BGR(A) and RGB(A) byte order, in place.
+ * bytesPerPixel must be 3 or 4. Uses SSSE3 or AVX2 byte shuffles when the CPU supports
+ * them, which is several times faster than swapping bytes one pixel at a time.
+ */
+void swapRedBlue(unsigned char* pixels, size_t numPixels, int bytesPerPixel);
+
 }  // namespace util
@@ -0,0 +1,155 @@
+/*
+ * Compile-time vertex layouts for TriangleSoup.
+ *
+ * Usage: A vertex format is a list of attributes. Each attribute has a shader location,
+ *        a source in the interleaved vertex data of TriangleSoup (x y z nx ny nz s t),
+ *        a number of components and a component type. Stride and offsets are computed
+ *        at compile time, so a mesh only stores the attributes its shader consumes:
+ *
+ *            // 16 bytes per vertex: float positions and normals packed to signed bytes
+ *            using LeanFormat = VertexFormat<Position<>, Normal<GLbyte, true>>;
+ *            mesh.setVertexFormat<LeanFormat>();
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// Map a C++ component type to the corresponding OpenGL type enum
+template <typename T>
+struct GLTypeOf;
+template <>
+struct GLTypeOf<GLfloat> {
+    static constexpr GLenum value = GL_FLOAT;
+};
+template <>
+struct GLTypeOf<GLbyte> {
+    static constexpr GLenum value = GL_BYTE;
+};
+template <>
+struct GLTypeOf<GLubyte> {
+    static constexpr GLenum value = GL_UNSIGNED_BYTE;
+};
+template <>
+struct GLTypeOf<GLshort> {
+    static constexpr GLenum value = GL_SHORT;
+};
+template <>
+struct GLTypeOf<GLushort> {
+    static constexpr GLenum value = GL_UNSIGNED_SHORT;
+};
+
+// Offset of the attribute data in the interleaved source vertex (8 floats per vertex)
+enum class VertexSource { Position = 0, Normal = 3, Texcoord = 6 };
+
+// Run-time description of one attribute, as passed to glVertexAttribPointer()
+struct VertexAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+};
+
+// Vertex data packed for one buffer, with the attributes it contains
+struct VertexStream {
+    std::vector<GLubyte> data;
+    std::vector<VertexAttribute> attributes;
+    GLsizei stride = 0;
+};
+
+template <GLuint Location, VertexSource Source, int Components, typename T = GLfloat,
+          bool Normalized = false>
+struct Attribute {
+    static_assert(Components >= 1 && Components <= 4, "Attributes have 1 to 4 components");
+    static_assert(!(Normalized && std::is_floating_point_v<T>),
+                  "Only integer types can be normalized");
+
+    using ComponentType = T;
+    static constexpr GLuint location = Location;
+    static constexpr int components = Components;
+    static constexpr bool normalized = Normalized;
+    // Size in bytes, padded to a multiple of 4 bytes for aligned vertex fetch
+    static constexpr std::size_t size = (Components * sizeof(T) + 3) & ~std::size_t(3);
+
+    // Convert the attribute of one source vertex and write it to dst
+    static void pack(const GLfloat* vertex, GLubyte* dst) {
+        for (int c = 0; c < Components; c++) {
+            const T value = convert(vertex[static_cast<int>(Source) + c]);
+            std::memcpy(dst + c * sizeof(T), &value, sizeof(T));
+        }
+    }
+
+private:
+    static T convert(GLfloat v) {
+        if constexpr (std::is_floating_point_v<T>) {
+            return static_cast<T>(v);
+        } else {
+            if constexpr (Normalized) {
+                // Signed types map [-1, 1] to [-max, max], unsigned types map [0, 1] to [0, max]
+                const float lo = std::is_signed_v<T> ? -1.0f : 0.0f;
+                v = std::clamp(v, lo, 1.0f) * static_cast<float>(std::numeric_limits<T>::max());
+            }
+            v = std::clamp(std::round(v), static_cast<float>(std::numeric_limits<T>::min()),
+                           static_cast<float>(std::numeric_limits<T>::max()));
+            return static_cast<T>(v);
+        }
+    }
+};
+
+// The attributes of TriangleSoup at their conventional shader locations 0, 1 and 2
+template <typename T = GLfloat, bool Normalized = false>
+using Position = Attribute<0, VertexSource::Position, 3, T, Normalized>;
+template <typename T = GLfloat, bool Normalized = false>
+using Normal = Attribute<1, VertexSource::Normal, 3, T, Normalized>;
+template <typename T = GLfloat, bool Normalized = false>
+using Texcoord = Attribute<2, VertexSource::Texcoord, 2, T, Normalized>;
+
+template <typename... Attributes>
+struct VertexFormat {
+    static_assert(sizeof...(Attributes) > 0, "A vertex format needs at least one attribute");
+
+    static constexpr GLsizei stride = static_cast<GLsizei>((Attributes::size + ...));
+
+    // Attribute descriptions with offsets computed from the attribute sizes
+    static constexpr std::array<VertexAttribute, sizeof...(Attributes)> attributes() {
+        std::array<VertexAttribute, sizeof...(Attributes)> result{};
+        std::size_t i = 0;
+        GLuint offset = 0;
+        ((result[i++] = VertexAttribute{Attributes::location, Attributes::components,
+                                        GLTypeOf<typename Attributes::ComponentType>::value,
+                                        Attributes::normalized ? GLboolean(GL_TRUE)
+                                                               : GLboolean(GL_FALSE),
+                                        offset},
+          offset += static_cast<GLuint>(Attributes::size)),
+         ...);
+        return result;
+    }
+
+    // Pack nverts interleaved source vertices (8 floats each) into this format
+    static VertexStream pack(const GLfloat* vertices, int nverts) {
+        constexpr auto attribs = attributes();
+        VertexStream stream;
+        stream.attributes.assign(attribs.begin(), attribs.end());
+        stream.stride = stride;
+        stream.data.resize(static_cast<std::size_t>(stride) * nverts);
+        for (int i = 0; i < nverts; i++) {
+            GLubyte* dst = &stream.data[static_cast<std::size_t>(stride) * i];
+            std::size_t offset = 0;
+            ((Attributes::pack(vertices + 8 * i, dst + offset), offset += Attributes::size), ...);
+        }
+        return stream;
+    }
+};
+
+// The full layout: position, normal and texture coordinates as floats (32 bytes)
+using DefaultVertexFormat = VertexFormat<Position<>, Normal<>, Texcoord<>>;
@@ -0,0 +1,691 @@
+/*
+ * Virtual texturing with a page file, a page table and a cache of pages
+ *
+ * Level k of the virtual texture is ceil(width / 2^k) x ceil(height / 2^k) pixels,
+ * split into pages of pageSize x pageSize pixels. A page is stored with a border of
+ * its neighbors' pixels on all sides, so that it can be sampled with bilinear
+ * filtering in the cache. The last level is a single page, which is always loaded.
+ *
+ * The feedback pass writes, for each pixel, the page it needs as a uint with x in
+ * bits 0-12, y in bits 13-25 and level + 1 in bits 26-31, or 0 for none.
+ *
+ * This code is in the public domain.
+ */
+#include "VirtualTexture.hpp"
+
+#include "GLState.hpp"
+#include "MipmapBuilder.hpp"
+#include "Texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+
+// Header of a page file, followed by the pages of each level, row by row from the bottom
+struct PageFileHeader {
+    char magic[4] = {'V', 'T', 'P', '1'};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t pageSize = 0;
+    uint32_t border = 0;
+    uint32_t levels = 0;
+    uint32_t srgb = 0;
+};
+
+static GLuint divideRoundUp(GLuint value, GLuint divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+// Size of a level: ceil(size / 2^level)
+static GLuint levelSize(GLuint size, GLuint level) {
+    return static_cast<GLuint>((static_cast<uint64_t>(size) + (1ull << level) - 1) >> level);
+}
+
+/*
+ * An image at one level, split into blocks (source files or pages). block(bx, by)
+ * returns the first pixel of a block, whose rows are rowStride bytes apart.
+ */
+struct BlockGrid {
+    GLuint width;
+    GLuint height;
+    GLuint blockWidth;
+    GLuint blockHeight;
+    size_t rowStride;
+    std::function<const GLubyte*(GLuint bx, GLuint by)> block;
+};
+
+/* Copy a region of RGBA pixels from a block grid, repeating the edges outside it */
+static void readRegion(const BlockGrid& grid, int64_t x0, int64_t y0, GLuint w, GLuint h,
+                       GLubyte* out) {
+    for (GLuint r = 0; r < h; r++) {
+        const GLuint y = static_cast<GLuint>(std::clamp<int64_t>(y0 + r, 0, grid.height - 1));
+        const GLuint by = y / grid.blockHeight;
+        const GLubyte* row = nullptr;
+        GLuint currentBlock = ~0u;
+        for (GLuint c = 0; c < w; c++) {
+            const GLuint x = static_cast<GLuint>(std::clamp<int64_t>(x0 + c, 0, grid.width - 1));
+            const GLuint bx = x / grid.blockWidth;
+            if (bx != currentBlock) {
+                row = grid.block(bx, by) + (y % grid.blockHeight) * grid.rowStride;
+                currentBlock = bx;
+            }
+            std::memcpy(out + 4 * (static_cast<size_t>(r) * w + c),
+                        row + 4 * static_cast<size_t>(x % grid.blockWidth), 4);
+        }
+    }
+}
+
+/* A small cache of decoded blocks, which drops the oldest block when full */
+class BlockCache {
+public:
+    explicit BlockCache(size_t capacity) : capacity_(capacity) {}
+
+    const GLubyte* get(uint64_t key, const std::function<void(std::vector<GLubyte>&)>& load) {
+        auto it = blocks_.find(key);
+        if (it != blocks_.end()) {
+            return it->second.data();
+        }
+        if (blocks_.size() >= capacity_) {
+            blocks_.erase(order_.front());
+            order_.pop_front();
+        }
+        std::vector<GLubyte>& data = blocks_[key];
+        load(data);
+        order_.push_back(key);
+        return data.data();
+    }
+
+private:
+    size_t capacity_;
+    std::unordered_map<uint64_t, std::vector<GLubyte>> blocks_;
+    std::deque<uint64_t> order_;
+};
+
+bool VirtualTexture::buildPageFile(const std::vector<std::string>& sources, GLuint columns,
+                                   const std::string& pageFile, bool srgb, GLuint pageSize,
+                                   GLuint border) {
+    if (sources.empty() || columns == 0 || sources.size() % columns != 0) {
+        std::cerr << "The source files must form a grid with " << columns << " columns\n";
+        return false;
+    }
+    const GLuint rows = static_cast<GLuint>(sources.size() / columns);
+
+    // All files have the size of the first
+    GLuint fileWidth = 0;
+    GLuint fileHeight = 0;
+    {
+        std::vector<GLubyte> first;
+        if (!Texture::loadRGBA(sources.front(), fileWidth, fileHeight, first)) {
+            return false;
+        }
+    }
+
+    PageFileHeader header;
+    header.width = fileWidth * columns;
+    header.height = fileHeight * rows;
+    header.pageSize = pageSize;
+    header.border = border;
+    header.srgb = srgb ? 1 : 0;
+    while (levelSize(header.width, header.levels) > pageSize ||
+           levelSize(header.height, header.levels) > pageSize) {
+        header.levels++;
+    }
+    header.levels++;
+
+    std::ofstream out(pageFile, std::ios_base::out | std::ios_base::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const GLuint stored = pageSize + 2 * border;  // Page size with borders
+    const size_t pageBytes = 4 * static_cast<size_t>(stored) * stored;
+    std::vector<GLubyte> page(pageBytes);
+    std::vector<GLubyte> region;
+    bool ok = true;
+
+    // Level 0 from the source files, keeping about two rows of files in memory
+    BlockCache files(2 * static_cast<size_t>(columns) + 2);
+    BlockGrid grid{header.width, header.height, fileWidth, fileHeight, 4 * size_t(fileWidth),
+                   [&](GLuint bx, GLuint by) {
+                       return files.get(by * columns + bx, [&](std::vector<GLubyte>& data) {
+                           GLuint w = 0;
+                           GLuint h = 0;
+                           if (!Texture::loadRGBA(sources[by * columns + bx], w, h, data) ||
+                               w != fileWidth || h != fileHeight) {
+                               std::cerr << "Source files must be " << fileWidth << "x"
+                                         << fileHeight << " ('" << sources[by * columns + bx]
+                                         << "')\n";
+                               data.assign(4 * size_t(fileWidth) * fileHeight, 0);
+                               ok = false;
+                           }
+                       });
+                   }};
+    for (GLuint py = 0; py < divideRoundUp(header.height, pageSize); py++) {
+        for (GLuint px = 0; px < divideRoundUp(header.width, pageSize); px++) {
+            readRegion(grid, int64_t(px) * pageSize - border, int64_t(py) * pageSize - border,
+                       stored, stored, page.data());
+            out.write(reinterpret_cast<const char*>(page.data()), pageBytes);
+        }
+    }
+
+    // Each further level from the pages of the level above, read back from the file
+    uint64_t levelStart = 0;  // Index of the first page of the previous level
+    for (GLuint level = 1; level < header.levels && ok; level++) {
+        out.flush();
+        std::ifstream in(pageFile, std::ios_base::in | std::ios_base::binary);
+        const GLuint prevWidth = levelSize(header.width, level - 1);
+        const GLuint prevHeight = levelSize(header.height, level - 1);
+        const GLuint prevPagesX = divideRoundUp(prevWidth, pageSize);
+        const GLuint prevPagesY = divideRoundUp(prevHeight, pageSize);
+
+        BlockCache pages(3 * static_cast<size_t>(prevPagesX) + 4);
+        BlockGrid prev{prevWidth, prevHeight, pageSize, pageSize, 4 * size_t(stored),
+                       [&](GLuint bx, GLuint by) {
+                           const uint64_t index = levelStart + uint64_t(by) * prevPagesX + bx;
+                           const GLubyte* data =
+                               pages.get(index, [&](std::vector<GLubyte>& p) {
+                                   p.resize(pageBytes);
+                                   in.seekg(static_cast<std::streamoff>(sizeof(header) +
+                                                                        index * pageBytes));
+                                   in.read(reinterpret_cast<char*>(p.data()), pageBytes);
+                               });
+                           return data + 4 * (static_cast<size_t>(border) * stored + border);
+                       }};
+
+        const GLuint width = levelSize(header.width, level);
+        const GLuint height = levelSize(header.height, level);
+        region.resize(4 * static_cast<size_t>(2 * stored) * (2 * stored));
+        for (GLuint py = 0; py < divideRoundUp(height, pageSize); py++) {
+            for (GLuint px = 0; px < divideRoundUp(width, pageSize); px++) {
+                readRegion(prev, 2 * (int64_t(px) * pageSize - border),
+                           2 * (int64_t(py) * pageSize - border), 2 * stored, 2 * stored,
+                           region.data());
+                const mipmap::Level half = mipmap::downsample(region.data(), 2 * stored,
+                                                              2 * stored, 4, srgb,
+                                                              mipmap::Filter::Box, 1);
+                out.write(reinterpret_cast<const char*>(half.data.data()), pageBytes);
+            }
+        }
+        if (!in) {
+            std::cerr << "Could not read back pages ('" << pageFile << "')\n";
+            ok = false;
+        }
+        levelStart += uint64_t(prevPagesX) * prevPagesY;
+    }
+
+    if (!out || !ok) {
+        std::cerr << "Could not write page file ('" << pageFile << "')\n";
+        return false;
+    }
+    std::cout << "Wrote page file with " << header.levels << " levels for a " << header.width
+              << "x" << header.height << " image ('" << pageFile << "')\n";
+    return true;
+}
+
+/*
+ * Open a page file, create the cache and page table textures, load the coarsest
+ * page and start the loader thread
+ */
+VirtualTexture::VirtualTexture(const std::string& pageFile, GLuint cacheSlots)
+    : pageFile_(pageFile), cacheSlots_(std::clamp(cacheSlots, 2u, 256u)) {
+    std::ifstream in(pageFile_, std::ios_base::in | std::ios_base::binary);
+    PageFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, "VTP1", 4) != 0 || header.levels == 0 ||
+        header.levels > 32 || header.pageSize == 0) {
+        std::cerr << "Could not open page file ('" << pageFile_ << "')\n";
+        return;
+    }
+    width_ = header.width;
+    height_ = header.height;
+    pageSize_ = header.pageSize;
+    border_ = header.border;
+    levels_ = header.levels;
+    srgb_ = (header.srgb != 0);
+    uint64_t pages = 0;
+    for (GLuint level = 0; level < levels_; level++) {
+        firstPage_.push_back(pages);
+        pages += uint64_t(pagesX(level)) * pagesY(level);
+    }
+
+    // Cache texture, with room for cacheSlots_ x cacheSlots_ pages including borders.
+    // Fewer slots are used if the texture would be larger than GL_MAX_TEXTURE_SIZE.
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    const GLuint maxSlots = static_cast<GLuint>(maxTextureSize) / (pageSize_ + 2 * border_);
+    if (maxSlots < 2) {
+        std::cerr << "Pages are too large for a cache texture ('" << pageFile_ << "')\n";
+        return;
+    }
+    if (cacheSlots_ > maxSlots) {
+        std::cerr << "Cache reduced to " << maxSlots << "x" << maxSlots
+                  << " pages to fit GL_MAX_TEXTURE_SIZE ('" << pageFile_ << "')\n";
+        cacheSlots_ = maxSlots;
+    }
+    const GLsizei cacheSize = static_cast<GLsizei>(cacheSlots_ * (pageSize_ + 2 * border_));
+    glGenTextures(1, &cacheTexture_);
+    glstate::bindTexture(GL_TEXTURE_2D, cacheTexture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, srgb_ ? GL_SRGB8_ALPHA8 : GL_RGBA8, cacheSize, cacheSize, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    slots_.assign(static_cast<size_t>(cacheSlots_) * cacheSlots_, Slot{invalidKey, 0});
+
+    // Page table with a power of two size, so that each mipmap level of it is large
+    // enough for the pages of that level
+    tableWidth_ = 1;
+    tableHeight_ = 1;
+    while (tableWidth_ < pagesX(0)) {
+        tableWidth_ *= 2;
+    }
+    while (tableHeight_ < pagesY(0)) {
+        tableHeight_ *= 2;
+    }
+    glGenTextures(1, &pageTableTexture_);
+    glstate::bindTexture(GL_TEXTURE_2D, pageTableTexture_);
+    for (GLuint level = 0; level < levels_; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8UI, std::max(tableWidth_ >> level, 1u),
+                     std::max(tableHeight_ >> level, 1u), 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                     nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels_ - 1);
+
+    // The coarsest level is a single page, which stays in slot 0 as the last fallback
+    std::vector<GLubyte> data;
+    const uint64_t top = pageKey(levels_ - 1, 0, 0);
+    if (readPage(in, top, data)) {
+        uploadPage(top, data, 0);
+    }
+    updatePageTable();
+
+    thread_ = std::thread(&VirtualTexture::loader, this);
+}
+
+VirtualTexture::~VirtualTexture() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        requestAvailable_.notify_all();
+        thread_.join();
+    }
+    if (feedbackFence_ != nullptr) {
+        glDeleteSync(feedbackFence_);
+    }
+    glstate::deleteBuffers(1, &feedbackBuffer_);
+    glDeleteRenderbuffers(1, &feedbackDepth_);
+    glstate::deleteTextures(1, &feedbackColor_);
+    glDeleteFramebuffers(1, &feedbackFramebuffer_);
+    glstate::deleteTextures(1, &pageTableTexture_);
+    glstate::deleteTextures(1, &cacheTexture_);
+}
+
+bool VirtualTexture::valid() const { return cacheTexture_ != 0; }
+
+uint64_t VirtualTexture::pageKey(GLuint level, GLuint x, GLuint y) {
+    return (uint64_t(level) << 48) | (uint64_t(y) << 24) | x;
+}
+
+GLuint VirtualTexture::levelWidth(GLuint level) const { return levelSize(width_, level); }
+
+GLuint VirtualTexture::levelHeight(GLuint level) const { return levelSize(height_, level); }
+
+GLuint VirtualTexture::pagesX(GLuint level) const {
+    return divideRoundUp(levelWidth(level), pageSize_);
+}
+
+GLuint VirtualTexture::pagesY(GLuint level) const {
+    return divideRoundUp(levelHeight(level), pageSize_);
+}
+
+std::streamoff VirtualTexture::pageOffset(uint64_t key) const {
+    const GLuint level = static_cast<GLuint>(key >> 48);
+    const GLuint y = static_cast<GLuint>((key >> 24) & 0xFFFFFF);
+    const GLuint x = static_cast<GLuint>(key & 0xFFFFFF);
+    const uint64_t index = firstPage_[level] + uint64_t(y) * pagesX(level) + x;
+    const size_t pageBytes = 4 * static_cast<size_t>(pageSize_ + 2 * border_) *
+                             (pageSize_ + 2 * border_);
+    return static_cast<std::streamoff>(sizeof(PageFileHeader) + index * pageBytes);
+}
+
+bool VirtualTexture::readPage(std::ifstream& in, uint64_t key, std::vector<GLubyte>& data) const {
+    const GLuint stored = pageSize_ + 2 * border_;
+    data.resize(4 * static_cast<size_t>(stored) * stored);
+    in.seekg(pageOffset(key));
+    in.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    if (!in) {
+        std::cerr << "Could not read page from page file ('" << pageFile_ << "')\n";
+        in.clear();
+        return false;
+    }
+    return true;
+}
+
+/* Load requested pages from the page file, coarsest first */
+void VirtualTexture::loader() {
+    std::ifstream in(pageFile_, std::ios_base::in | std::ios_base::binary);
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        requestAvailable_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+        if (stop_) {
+            return;
+        }
+        const uint64_t key = requests_.front();
+        requests_.pop_front();
+        lock.unlock();
+
+        std::vector<GLubyte> data;
+        const bool ok = readPage(in, key, data);
+
+        lock.lock();
+        if (ok) {
+            loaded_.emplace_back(key, std::move(data));
+        } else {
+            loading_.erase(key);
+        }
+    }
+}
+
+void VirtualTexture::beginFeedback(GLsizei width, GLsizei height, GLsizei viewportWidth) {
+    if (feedbackFramebuffer_ == 0) {
+        glGenFramebuffers(1, &feedbackFramebuffer_);
+        glGenTextures(1, &feedbackColor_);
+        glGenRenderbuffers(1, &feedbackDepth_);
+        glGenBuffers(1, &feedbackBuffer_);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer_);
+    if (width != feedbackWidth_ || height != feedbackHeight_) {
+        feedbackWidth_ = width;
+        feedbackHeight_ = height;
+        glstate::bindTexture(GL_TEXTURE_2D, feedbackColor_);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, width, height, 0, GL_RED_INTEGER,
+                     GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               feedbackColor_, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                                  feedbackDepth_);
+    }
+    // The feedback pass sees fewer pixels, so its mipmap levels come out coarser
+    lodBias_ = std::log2(static_cast<float>(viewportWidth) / static_cast<float>(width));
+
+    glViewport(0, 0, width, height);
+    const GLuint none[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, none);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void VirtualTexture::endFeedback() {
+    // Read back asynchronously, unless the previous readback is still in flight
+    if (feedbackFence_ == nullptr) {
+        glstate::bindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffer_);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 4 * static_cast<GLsizeiptr>(feedbackWidth_) *
+                                               feedbackHeight_,
+                     nullptr, GL_STREAM_READ);
+        glReadPixels(0, 0, feedbackWidth_, feedbackHeight_, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                     nullptr);
+        glstate::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        feedbackFence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+/*
+ * Collect the pages in a finished readback. Pages in the cache are marked as used,
+ * missing pages and their missing coarser pages are requested from the loader.
+ */
+void VirtualTexture::processFeedback() {
+    if (feedbackFence_ == nullptr) {
+        return;
+    }
+    const GLenum status = glClientWaitSync(feedbackFence_, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return;
+    }
+    glDeleteSync(feedbackFence_);
+    feedbackFence_ = nullptr;
+
+    std::unordered_set<uint32_t> seen;
+    glstate::bindBuffer(GL_PIXEL_PACK_BUFFER, feedbackBuffer_);
+    const size_t count = static_cast<size_t>(feedbackWidth_) * feedbackHeight_;
+    const uint32_t* pixels = static_cast<const uint32_t*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4 * count, GL_MAP_READ_BIT));
+    if (pixels != nullptr) {
+        for (size_t i = 0; i < count; i++) {
+            if (pixels[i] != 0) {
+                seen.insert(pixels[i]);
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glstate::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Missing pages, coarsest first since they are the fallback of the finer ones
+    std::map<uint64_t, bool, std::greater<uint64_t>> wanted;
+    for (uint32_t value : seen) {
+        GLuint level = (value >> 26) - 1;
+        GLuint x = value & 0x1FFF;
+        GLuint y = (value >> 13) & 0x1FFF;
+        if (level >= levels_ || x >= pagesX(level) || y >= pagesY(level)) {
+            continue;
+        }
+        for (; level < levels_; level++, x /= 2, y /= 2) {
+            const uint64_t key = pageKey(level, x, y);
+            auto it = resident_.find(key);
+            if (it != resident_.end()) {
+                slots_[it->second].lastUsed = frame_;
+            } else {
+                wanted[key] = true;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Pages which are no longer visible are not loaded
+    for (uint64_t key : requests_) {
+        loading_.erase(key);
+    }
+    requests_.clear();
+    for (const auto& entry : wanted) {
+        if (loading_.insert(entry.first).second) {
+            requests_.push_back(entry.first);
+        }
+    }
+    if (!requests_.empty()) {
+        requestAvailable_.notify_one();
+    }
+}
+
+/* Copy a page to a slot in the cache texture */
+void VirtualTexture::uploadPage(uint64_t key, const std::vector<GLubyte>& data, size_t slot) {
+    const GLuint stored = pageSize_ + 2 * border_;
+    glstate::bindTexture(GL_TEXTURE_2D, cacheTexture_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>((slot % cacheSlots_) * stored),
+                    static_cast<GLint>((slot / cacheSlots_) * stored), stored, stored, GL_RGBA,
+                    GL_UNSIGNED_BYTE, data.data());
+    if (slots_[slot].key != invalidKey) {
+        resident_.erase(slots_[slot].key);
+    }
+    slots_[slot] = Slot{key, frame_};
+    resident_[key] = slot;
+    tableChanged_ = true;
+}
+
+void VirtualTexture::update(unsigned maxUploads) {
+    if (!valid()) {
+        return;
+    }
+    processFeedback();
+
+    std::vector<std::pair<uint64_t, std::vector<GLubyte>>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const size_t count = std::min<size_t>(maxUploads, loaded_.size());
+        for (size_t i = 0; i < count; i++) {
+            loading_.erase(loaded_[i].first);
+        }
+        loaded.assign(std::make_move_iterator(loaded_.begin()),
+                      std::make_move_iterator(loaded_.begin() + count));
+        loaded_.erase(loaded_.begin(), loaded_.begin() + count);
+    }
+
+    for (const auto& [key, data] : loaded) {
+        if (resident_.count(key) != 0) {
+            continue;
+        }
+        // Use the least recently used slot, but never slot 0 with the coarsest page,
+        // and never a page which was visible in this frame
+        size_t slot = 0;
+        uint64_t oldest = frame_;
+        for (size_t i = 1; i < slots_.size(); i++) {
+            if (slots_[i].key == invalidKey) {
+                slot = i;
+                break;
+            }
+            if (slots_[i].lastUsed < oldest) {
+                oldest = slots_[i].lastUsed;
+                slot = i;
+            }
+        }
+        if (slot == 0) {
+            break;  // The cache is full of visible pages
+        }
+        uploadPage(key, data, slot);
+    }
+
+    if (tableChanged_) {
+        updatePageTable();
+    }
+    frame_++;
+}
+
+/*
+ * Rebuild the page table from the coarsest level down. Each entry first inherits the
+ * entry of the page covering it one level up, then the pages in the cache are set
+ * to point to their own slot.
+ */
+void VirtualTexture::updatePageTable() {
+    std::vector<std::vector<std::pair<uint64_t, size_t>>> residentByLevel(levels_);
+    for (const auto& [key, slot] : resident_) {
+        residentByLevel[key >> 48].emplace_back(key, slot);
+    }
+
+    std::vector<GLubyte> coarser;
+    for (GLuint level = levels_; level-- > 0;) {
+        const GLuint w = std::max(tableWidth_ >> level, 1u);
+        const GLuint h = std::max(tableHeight_ >> level, 1u);
+        std::vector<GLubyte> table(4 * static_cast<size_t>(w) * h, 0);
+        if (!coarser.empty()) {
+            const GLuint coarserWidth = std::max(tableWidth_ >> (level + 1), 1u);
+            for (GLuint y = 0; y < pagesY(level); y++) {
+                for (GLuint x = 0; x < pagesX(level); x++) {
+                    std::memcpy(&table[4 * (static_cast<size_t>(y) * w + x)],
+                                &coarser[4 * (static_cast<size_t>(y / 2) * coarserWidth + x / 2)],
+                                4);
+                }
+            }
+        }
+        for (const auto& [key, slot] : residentByLevel[level]) {
+            const size_t x = key & 0xFFFFFF;
+            const size_t y = (key >> 24) & 0xFFFFFF;
+            GLubyte* entry = &table[4 * (y * w + x)];
+            entry[0] = static_cast<GLubyte>(slot % cacheSlots_);
+            entry[1] = static_cast<GLubyte>(slot / cacheSlots_);
+            entry[2] = static_cast<GLubyte>(level);
+        }
+        glstate::bindTexture(GL_TEXTURE_2D, pageTableTexture_);
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE,
+                        table.data());
+        coarser = std::move(table);
+    }
+    tableChanged_ = false;
+}
+
+void VirtualTexture::setUniforms(GLuint program, GLuint pageTableUnit, GLuint cacheUnit) const {
+    glstate::activeTexture(GL_TEXTURE0 + pageTableUnit);
+    glstate::bindTexture(GL_TEXTURE_2D, pageTableTexture_);
+    glstate::activeTexture(GL_TEXTURE0 + cacheUnit);
+    glstate::bindTexture(GL_TEXTURE_2D, cacheTexture_);
+    glstate::activeTexture(GL_TEXTURE0);
+
+    const GLfloat cacheSize = static_cast<GLfloat>(cacheSlots_ * (pageSize_ + 2 * border_));
+    glstate::useProgram(program);
+    glUniform1i(glGetUniformLocation(program, "vtPageTable"), static_cast<GLint>(pageTableUnit));
+    glUniform1i(glGetUniformLocation(program, "vtCache"), static_cast<GLint>(cacheUnit));
+    glUniform2f(glGetUniformLocation(program, "vtSize"), static_cast<GLfloat>(width_),
+                static_cast<GLfloat>(height_));
+    glUniform1f(glGetUniformLocation(program, "vtPageSize"), static_cast<GLfloat>(pageSize_));
+    glUniform1f(glGetUniformLocation(program, "vtBorder"), static_cast<GLfloat>(border_));
+    glUniform1f(glGetUniformLocation(program, "vtCacheSize"), cacheSize);
+    glUniform1i(glGetUniformLocation(program, "vtLevels"), static_cast<GLint>(levels_));
+    glUniform1f(glGetUniformLocation(program, "vtLodBias"), lodBias_);
+}
+
+const char* VirtualTexture::glslSource() {
+    return R"glsl(
+uniform usampler2D vtPageTable;
+uniform sampler2D vtCache;
+uniform vec2 vtSize;        // Size of the virtual texture in pixels
+uniform float vtPageSize;   // Pixels per page, without borders
+uniform float vtBorder;     // Border pixels on each side of a page
+uniform float vtCacheSize;  // Size of the cache texture in pixels
+uniform int vtLevels;       // Number of mipmap levels
+uniform float vtLodBias;    // Makes up for the lower resolution of the feedback pass
+
+float vtLod(vec2 uv) {
+    vec2 dx = dFdx(uv * vtSize);
+    vec2 dy = dFdy(uv * vtSize);
+    return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+
+vec4 vtSampleLevel(vec2 uv, int level) {
+    vec2 pagePos = uv * vtSize / (exp2(float(level)) * vtPageSize);
+    ivec2 tableSize = textureSize(vtPageTable, level);
+    uvec4 entry = texelFetch(vtPageTable, clamp(ivec2(pagePos), ivec2(0), tableSize - 1), level);
+    vec2 mappedPos = uv * vtSize / (exp2(float(entry.b)) * vtPageSize);
+    vec2 texel = vec2(entry.rg) * (vtPageSize + 2.0 * vtBorder) + vtBorder +
+                 fract(mappedPos) * vtPageSize;
+    return textureLod(vtCache, texel / vtCacheSize, 0.0);
+}
+
+// Sample the virtual texture, with linear filtering between mipmap levels
+vec4 vtSample(vec2 uv) {
+    uv = clamp(uv, vec2(0.0), vec2(1.0 - 1e-6));
+    float lod = clamp(vtLod(uv), 0.0, float(vtLevels - 1));
+    int level = int(lod);
+    vec4 fine = vtSampleLevel(uv, level);
+    vec4 coarse = vtSampleLevel(uv, min(level + 1, vtLevels - 1));
+    return mix(fine, coarse, fract(lod));
+}
+
+// The page needed at uv, for the output of the feedback pass
+uint vtFeedback(vec2 uv) {
+    uv = clamp(uv, vec2(0.0), vec2(1.0 - 1e-6));
+    int level = int(clamp(vtLod(uv) - vtLodBias, 0.0, float(vtLevels - 1)));
+    uvec2 page = uvec2(uv * vtSize / (exp2(float(level)) * vtPageSize));
+    return page.x | (page.y << 13u) | (uint(level + 1) << 26u);
+}
+)glsl";
+}
+
+size_t VirtualTexture::residentPages() const { return resident_.size(); }
+
+size_t VirtualTexture::memoryUsage() const {
+    const size_t cacheSize = cacheSlots_ * (pageSize_ + 2 * static_cast<size_t>(border_));
+    size_t bytes = 4 * cacheSize * cacheSize;
+    for (GLuint level = 0; level < levels_; level++) {
+        bytes += 4 * static_cast<size_t>(std::max(tableWidth_ >> level, 1u)) *
+                 std::max(tableHeight_ >> level, 1u);
+    }
+    return bytes;
+}
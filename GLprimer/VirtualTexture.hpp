@@ -0,0 +1,154 @@
+/*
+ * Virtual texturing, to display images far larger than fit in memory.
+ *
+ * The image and its mipmaps are split offline into pages of equal size, which are
+ * stored in a page file. At run time, only the pages which are visible are kept in a
+ * cache texture of fixed size, so memory use does not depend on the image size.
+ * A page table texture maps each page to its place in the cache, or to the place
+ * of the closest coarser page in the cache if it is not loaded.
+ *
+ * Usage: Call buildPageFile() once to convert a grid of TGA files (which can hold
+ *        images larger than the 65535 pixels a TGA file is limited to) into a page file.
+ *        Create a VirtualTexture from the page file. Paste glslSource() into the
+ *        fragment shaders which use it, and call vtSample(uv) instead of texture().
+ *        Each frame:
+ *         - call beginFeedback(), draw the scene with a shader that writes
+ *           vtFeedback(uv) to a uint output, and call endFeedback()
+ *         - call update() to load the pages the feedback pass asked for
+ *         - call setUniforms() for the programs which sample the virtual texture
+ *           or write feedback, and draw the scene
+ *        The feedback pass can run at a much lower resolution than the screen.
+ *        The TGA files, and thus the pages, are ordered from the bottom left,
+ *        in rows, like texture coordinates.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GL/glew.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+class VirtualTexture {
+public:
+    /*
+     * Split a grid of TGA files of equal size, given row by row from the bottom left,
+     * into pages of pageSize x pageSize pixels with a border of repeated neighbor
+     * pixels, for all mipmap levels. With srgb = true, mipmaps are filtered in linear
+     * light and the cache texture is sRGB. Memory use is a few rows of source files.
+     */
+    static bool buildPageFile(const std::vector<std::string>& sources, GLuint columns,
+                              const std::string& pageFile, bool srgb = false,
+                              GLuint pageSize = 128, GLuint border = 4);
+
+    /*
+     * Open a page file. The cache holds cacheSlots x cacheSlots pages (at most 256, and
+     * fewer if the cache texture would be larger than GL_MAX_TEXTURE_SIZE).
+     * The coarsest level is loaded right away, the rest is loaded as it is needed.
+     */
+    explicit VirtualTexture(const std::string& pageFile, GLuint cacheSlots = 16);
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    // True if the page file could be opened
+    bool valid() const;
+
+    /*
+     * Start the feedback pass in a framebuffer of width x height, which should have the
+     * aspect ratio of the viewport of viewportWidth pixels. Sets the viewport.
+     */
+    void beginFeedback(GLsizei width, GLsizei height, GLsizei viewportWidth);
+
+    // End the feedback pass and start reading it back. Binds the default framebuffer.
+    void endFeedback();
+
+    // Handle the feedback, and upload at most maxUploads loaded pages to the cache
+    void update(unsigned maxUploads = 16);
+
+    // Bind the page table and cache textures, and set the uniforms for glslSource()
+    void setUniforms(GLuint program, GLuint pageTableUnit = 14, GLuint cacheUnit = 15) const;
+
+    // GLSL functions vtSample() and vtFeedback(), for #version 330 fragment shaders
+    static const char* glslSource();
+
+    // Number of pages in the cache
+    size_t residentPages() const;
+
+    // GPU memory of the cache and page table textures, in bytes
+    size_t memoryUsage() const;
+
+private:
+    struct Slot {
+        uint64_t key;       // Page in the slot, or invalidKey
+        uint64_t lastUsed;  // Frame in which the page was last visible
+    };
+
+    // Page identifier: level, x and y packed into 64 bits
+    static uint64_t pageKey(GLuint level, GLuint x, GLuint y);
+    static const uint64_t invalidKey = ~0ull;
+
+    GLuint levelWidth(GLuint level) const;
+    GLuint levelHeight(GLuint level) const;
+    GLuint pagesX(GLuint level) const;
+    GLuint pagesY(GLuint level) const;
+    std::streamoff pageOffset(uint64_t key) const;
+
+    bool readPage(std::ifstream& in, uint64_t key, std::vector<GLubyte>& data) const;
+    void loader();
+    void processFeedback();
+    void uploadPage(uint64_t key, const std::vector<GLubyte>& data, size_t slot);
+    void updatePageTable();
+
+    // Page file layout
+    std::string pageFile_;
+    GLuint width_ = 0;
+    GLuint height_ = 0;
+    GLuint pageSize_ = 0;
+    GLuint border_ = 0;
+    GLuint levels_ = 0;
+    bool srgb_ = false;
+    std::vector<uint64_t> firstPage_;  // Index of the first page of each level
+
+    // Cache
+    GLuint cacheSlots_;
+    GLuint cacheTexture_ = 0;
+    std::vector<Slot> slots_;
+    std::unordered_map<uint64_t, size_t> resident_;  // Slot of each page in the cache
+    uint64_t frame_ = 1;
+
+    // Page table, one level for each mipmap level, with (slot x, slot y, level, 0)
+    GLuint pageTableTexture_ = 0;
+    GLuint tableWidth_ = 0;
+    GLuint tableHeight_ = 0;
+    bool tableChanged_ = true;
+
+    // Feedback
+    GLuint feedbackFramebuffer_ = 0;
+    GLuint feedbackColor_ = 0;
+    GLuint feedbackDepth_ = 0;
+    GLuint feedbackBuffer_ = 0;  // Pixel pack buffer for the readback
+    GLsizei feedbackWidth_ = 0;
+    GLsizei feedbackHeight_ = 0;
+    GLsync feedbackFence_ = nullptr;
+    float lodBias_ = 0.0f;
+
+    // Loader thread
+    std::mutex mutex_;
+    std::condition_variable requestAvailable_;
+    std::deque<uint64_t> requests_;        // Pages to load, in order
+    std::unordered_set<uint64_t> loading_;  // Requested, and not yet uploaded
+    std::vector<std::pair<uint64_t, std::vector<GLubyte>>> loaded_;  // Loaded, not uploaded
+    bool stop_ = false;
+    std::thread thread_;
+};